@@ -0,0 +1,55 @@
+#ifndef ILP_BLOCK_H
+#define ILP_BLOCK_H
+
+#include "dr_api.h"
+#include "depgraph.h"
+#include "mix.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/* Per-fragment analysis, computed once when the block is built and
+ * weighted by exec_count at exit.
+ */
+typedef struct {
+    app_pc   start_pc;
+    int32_t  ni;
+    int32_t  ilp;           /* x1000 */
+    int32_t  dep_cycles;    /* latency-weighted critical path */
+    int32_t  port_cycles;   /* port-pressure throughput bound, x1000 */
+    int32_t  sched_cycles;  /* list-scheduled length */
+    int32_t  fused_ni;      /* fused-domain uops */
+    int32_t  fused_ilp;     /* x1000, in fused-domain uops */
+    int32_t  macro_fused;   /* flag-setter + jcc pairs */
+    int32_t  micro_fused;   /* load+op / store instrs in one uop */
+    int32_t  false_ilp;     /* x1000, with false_deps honoured */
+    int32_t  live_gprs;     /* max simultaneously live, dataflow schedule */
+    int32_t  live_vecs;
+    int32_t  lanes;         /* elements operated on by all instructions */
+    int32_t  simd_ni;       /* instructions with vector operands */
+    int32_t  simd_lanes;    /* their lanes, and at SIMD_MAX_BITS width */
+    int32_t  simd_max_lanes;
+    int32_t  loads;         /* instructions reading memory */
+    int32_t  load_depths;   /* distinct dataflow depths they issue at */
+    int32_t  mlp_peak;      /* most loads issuing at one depth */
+    int32_t  mix_ni[MIX_CLASSES];       /* instructions of each class */
+    int32_t  mix_cycles[MIX_CLASSES];   /* critical path of its sub-graph */
+    app_pc   cbr_pc;        /* closing conditional branch, or NULL */
+    app_pc   cbr_target;
+    app_pc   cbr_fall;      /* first byte after it */
+    int8_t   x87_top;       /* x87 top of stack at exit, from entry's */
+    int8_t   x87_slot[8];   /* entry name of the value at each position */
+    bool     x87_init;      /* fninit or frstor: exit top is absolute */
+    uint64_t exec_count;
+    dep_graph graph;
+    std::vector<false_dep> false_deps;
+    std::vector<uint8_t> slot_sizes;    /* bytes accessed through each slot */
+    std::vector<uint16_t> profile;      /* instructions issuing at depth d */
+    std::vector<std::string> disasm;    /* per node, only with -critical */
+} block_info;
+
+/* "module+0xoffset" when the pc belongs to a module */
+std::string block_location(app_pc pc);
+
+#endif /* ILP_BLOCK_H */
@@ -0,0 +1,212 @@
+#include "bpred.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+using namespace std;
+
+/* gshare: 2-bit counters indexed by pc xor global history */
+#define GSHARE_BITS 14
+
+/* TAGE-lite: a bimodal base plus four tagged tables with geometrically
+ * growing history lengths, all kept within one 64-bit history register.
+ */
+#define BASE_BITS       12
+#define TAGE_TABLES     4
+#define TAGE_INDEX_BITS 10
+#define TAGE_TAG_BITS   9
+
+static const int tage_history[TAGE_TABLES] = { 5, 12, 27, 64 };
+
+typedef struct {
+    uint16_t tag;
+    int8_t   ctr;       /* -4..3, taken when >= 0 */
+    uint8_t  useful;    /* 0..3 */
+} tage_entry;
+
+struct _bpred_state {
+    bpred_kind         kind;
+    uint64_t           history;
+    vector<uint8_t>    counters;    /* gshare table or TAGE base */
+    vector<tage_entry> tables[TAGE_TABLES];
+};
+
+static const char* const bpred_names[] = { "perfect", "gshare", "tage" };
+
+bool
+bpred_parse(const char* name, bpred_kind* kind)
+{
+    for (int i = 0; i <= BPRED_TAGE; ++i)
+    {
+        if (strcmp(name, bpred_names[i]) == 0)
+        {
+            *kind = (bpred_kind) i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char*
+bpred_name(bpred_kind kind)
+{
+    return bpred_names[kind];
+}
+
+bpred_state*
+bpred_create(bpred_kind kind)
+{
+    bpred_state* bp = new bpred_state();
+    bp->kind = kind;
+    bp->history = 0;
+    if (kind == BPRED_GSHARE)
+        bp->counters.assign(1 << GSHARE_BITS, 1);
+    else if (kind == BPRED_TAGE)
+    {
+        bp->counters.assign(1 << BASE_BITS, 1);
+        tage_entry empty = { 0, 0, 0 };
+        for (int i = 0; i < TAGE_TABLES; ++i)
+            bp->tables[i].assign(1 << TAGE_INDEX_BITS, empty);
+    }
+    return bp;
+}
+
+void
+bpred_destroy(bpred_state* bp)
+{
+    delete bp;
+}
+
+static inline void
+train_counter(uint8_t& ctr, bool taken)
+{
+    if (taken && ctr < 3)
+        ctr++;
+    else if (!taken && ctr > 0)
+        ctr--;
+}
+
+static bool
+gshare_update(bpred_state* bp, ptr_uint_t pc, bool taken)
+{
+    uint32_t mask = (1 << GSHARE_BITS) - 1;
+    uint8_t& ctr = bp->counters[(pc ^ bp->history) & mask];
+    bool pred = ctr >= 2;
+    train_counter(ctr, taken);
+    return pred == taken;
+}
+
+static inline uint32_t
+fold_history(uint64_t history, int length, int bits)
+{
+    if (length < 64)
+        history &= ((uint64_t) 1 << length) - 1;
+    uint32_t folded = 0;
+    for (; history != 0; history >>= bits)
+        folded ^= (uint32_t) (history & ((1 << bits) - 1));
+    return folded;
+}
+
+static inline uint32_t
+tage_index(const bpred_state* bp, int table, ptr_uint_t pc)
+{
+    return (uint32_t) (pc ^ (pc >> TAGE_INDEX_BITS)
+        ^ fold_history(bp->history, tage_history[table], TAGE_INDEX_BITS))
+        & ((1 << TAGE_INDEX_BITS) - 1);
+}
+
+static inline uint16_t
+tage_tag(const bpred_state* bp, int table, ptr_uint_t pc)
+{
+    int len = tage_history[table];
+    return (uint16_t) ((pc ^ fold_history(bp->history, len, TAGE_TAG_BITS)
+        ^ (fold_history(bp->history, len, TAGE_TAG_BITS - 1) << 1))
+        & ((1 << TAGE_TAG_BITS) - 1));
+}
+
+static bool
+tage_update(bpred_state* bp, ptr_uint_t pc, bool taken)
+{
+    uint32_t index[TAGE_TABLES];
+    uint16_t tag[TAGE_TABLES];
+    int provider = -1, alt = -1;
+    for (int i = TAGE_TABLES - 1; i >= 0; --i)
+    {
+        index[i] = tage_index(bp, i, pc);
+        tag[i] = tage_tag(bp, i, pc);
+        if (bp->tables[i][index[i]].tag == tag[i])
+        {
+            if (provider < 0)
+                provider = i;
+            else if (alt < 0)
+                alt = i;
+        }
+    }
+
+    uint8_t& base = bp->counters[pc & ((1 << BASE_BITS) - 1)];
+    bool base_pred = base >= 2;
+    bool alt_pred = (alt >= 0) ? bp->tables[alt][index[alt]].ctr >= 0
+                               : base_pred;
+    bool pred = base_pred;
+
+    if (provider >= 0)
+    {
+        tage_entry& e = bp->tables[provider][index[provider]];
+        pred = e.ctr >= 0;
+        if (pred != alt_pred)
+        {
+            if (pred == taken && e.useful < 3)
+                e.useful++;
+            else if (pred != taken && e.useful > 0)
+                e.useful--;
+        }
+        if (taken && e.ctr < 3)
+            e.ctr++;
+        else if (!taken && e.ctr > -4)
+            e.ctr--;
+    }
+    else
+        train_counter(base, taken);
+
+    /* On a miss, claim an entry in a table with longer history */
+    if (pred != taken && provider < TAGE_TABLES - 1)
+    {
+        bool allocated = false;
+        for (int i = provider + 1; i < TAGE_TABLES && !allocated; ++i)
+        {
+            tage_entry& e = bp->tables[i][index[i]];
+            if (e.useful == 0)
+            {
+                e.tag = tag[i];
+                e.ctr = taken ? 0 : -1;
+                allocated = true;
+            }
+        }
+        for (int i = provider + 1; i < TAGE_TABLES && !allocated; ++i)
+        {
+            if (bp->tables[i][index[i]].useful > 0)
+                bp->tables[i][index[i]].useful--;
+        }
+    }
+    return pred == taken;
+}
+
+bool
+bpred_update(bpred_state* bp, app_pc pc, bool taken)
+{
+    bool hit = true;
+    switch (bp->kind)
+    {
+    case BPRED_PERFECT:
+        return true;
+    case BPRED_GSHARE:
+        hit = gshare_update(bp, (ptr_uint_t) pc, taken);
+        break;
+    case BPRED_TAGE:
+        hit = tage_update(bp, (ptr_uint_t) pc, taken);
+        break;
+    }
+    bp->history = (bp->history << 1) | (taken ? 1 : 0);
+    return hit;
+}
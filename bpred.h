@@ -0,0 +1,28 @@
+#ifndef ILP_BPRED_H
+#define ILP_BPRED_H
+
+#include "dr_api.h"
+
+/* Conditional branch predictors for the dynamic engine.  Each thread owns
+ * its own predictor state, as each core would.
+ */
+
+typedef enum {
+    BPRED_PERFECT,
+    BPRED_GSHARE,
+    BPRED_TAGE,
+} bpred_kind;
+
+typedef struct _bpred_state bpred_state;
+
+bool bpred_parse(const char* name, bpred_kind* kind);
+const char* bpred_name(bpred_kind kind);
+bpred_state* bpred_create(bpred_kind kind);
+void bpred_destroy(bpred_state* bp);
+
+/* Predicts the branch at pc, trains on the real outcome and returns
+ * whether the prediction was right.
+ */
+bool bpred_update(bpred_state* bp, app_pc pc, bool taken);
+
+#endif /* ILP_BPRED_H */
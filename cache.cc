@@ -0,0 +1,80 @@
+#include "cache.h"
+
+#include <stdlib.h>
+
+using namespace std;
+
+/* "size:ways:latency", size with an optional k/m suffix, e.g. 32k:8:4 */
+bool
+cache_parse_config(const char* spec, cache_config* config)
+{
+    char* end;
+    unsigned long size = strtoul(spec, &end, 10);
+    if (*end == 'k' || *end == 'K')
+        size <<= 10, ++end;
+    else if (*end == 'm' || *end == 'M')
+        size <<= 20, ++end;
+    if (*end++ != ':')
+        return false;
+
+    unsigned long ways = strtoul(end, &end, 10);
+    if (*end++ != ':')
+        return false;
+    long latency = strtol(end, &end, 10);
+    if (*end != '\0' || ways == 0 || latency < 0
+        || size < (ways << CACHE_LINE_BITS))
+        return false;
+
+    config->size = (uint32_t) size;
+    config->ways = (uint32_t) ways;
+    config->latency = (int) latency;
+    return true;
+}
+
+void
+cache_init(cache_sim* sim, const cache_config* configs)
+{
+    for (int i = 0; i < CACHE_LEVELS; ++i)
+    {
+        cache_level& level = sim->levels[i];
+        level.ways = configs[i].ways;
+        level.sets = (configs[i].size >> CACHE_LINE_BITS) / level.ways;
+        level.tags.assign(level.sets * level.ways, 0);
+        level.stamps.assign(level.sets * level.ways, 0);
+    }
+    sim->clock = 0;
+}
+
+static bool
+lookup(cache_level& level, uint64_t line, uint64_t now)
+{
+    uint32_t base = (uint32_t) (line % level.sets) * level.ways;
+    uint32_t victim = base;
+    for (uint32_t i = base; i < base + level.ways; ++i)
+    {
+        if (level.tags[i] == line + 1)
+        {
+            level.stamps[i] = now;
+            return true;
+        }
+        if (level.stamps[i] < level.stamps[victim])
+            victim = i;
+    }
+    level.tags[victim] = line + 1;
+    level.stamps[victim] = now;
+    return false;
+}
+
+int
+cache_access(cache_sim* sim, ptr_uint_t addr)
+{
+    uint64_t line = (uint64_t) addr >> CACHE_LINE_BITS;
+    uint64_t now = ++sim->clock;
+    for (int i = 0; i < CACHE_LEVELS; ++i)
+    {
+        /* A miss fills the line into this level on the way */
+        if (lookup(sim->levels[i], line, now))
+            return i;
+    }
+    return CACHE_MEMORY;
+}
@@ -0,0 +1,43 @@
+#ifndef ILP_CACHE_H
+#define ILP_CACHE_H
+
+#include "dr_api.h"
+
+#include <stdint.h>
+#include <vector>
+
+/* Set-associative, inclusive, LRU cache hierarchy with 64-byte lines.
+ * Every thread simulates its own hierarchy so no locking is needed.
+ */
+
+#define CACHE_LEVELS 3
+#define CACHE_MEMORY CACHE_LEVELS       /* level index of a full miss */
+#define CACHE_LINE_BITS 6
+
+typedef struct {
+    uint32_t size;      /* bytes */
+    uint32_t ways;
+    int      latency;   /* load-to-use cycles on a hit */
+} cache_config;
+
+typedef struct {
+    uint32_t              sets;
+    uint32_t              ways;
+    std::vector<uint64_t> tags;     /* sets * ways, line address + 1 */
+    std::vector<uint64_t> stamps;   /* last use, for LRU */
+} cache_level;
+
+typedef struct {
+    cache_level levels[CACHE_LEVELS];
+    uint64_t    clock;
+} cache_sim;
+
+bool cache_parse_config(const char* spec, cache_config* config);
+void cache_init(cache_sim* sim, const cache_config* configs);
+
+/* Returns the level that served the access, CACHE_MEMORY on a full miss,
+ * and fills the line into every level.
+ */
+int cache_access(cache_sim* sim, ptr_uint_t addr);
+
+#endif /* ILP_CACHE_H */
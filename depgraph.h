@@ -0,0 +1,81 @@
+#ifndef ILP_DEPGRAPH_H
+#define ILP_DEPGRAPH_H
+
+#include "dr_api.h"
+
+#include <stdint.h>
+#include <vector>
+
+/* Dependency DAG of a block as built by calculate_ilp.  Nodes are in
+ * program order and edges always point backwards, so a forward walk over
+ * the nodes is a topological order.
+ */
+
+enum {
+    DEP_REG  = 0x01,
+    DEP_FLAG = 0x02,
+    DEP_MEM  = 0x04,
+    DEP_RAW  = 0x10,
+    DEP_WAW  = 0x20,
+    DEP_WAR  = 0x40,
+};
+
+/* Resources tracked by the dynamic engine: DR register ids followed by
+ * one id per arithmetic flag bit.
+ */
+#define RES_FLAG(flag)  (DR_REG_LAST_VALID_ENUM + 1 + __builtin_ctz(flag))
+#define NUM_RESOURCES   (DR_REG_LAST_VALID_ENUM + 1 + 12)
+
+/* Captured-address slots per block; later operands are left unknown */
+#define MAX_MEM_SLOTS    255
+#define MEM_SLOT_UNKNOWN 255
+
+/* Captured destination-value slots, one per node writing a GPR */
+#define MAX_VALUE_SLOTS  255
+#define VALUE_SLOT_NONE  255
+
+typedef struct {
+    int     from;       /* index of the producing node */
+    uint8_t kind;       /* DEP_* bits, or-ed if several resources */
+} dep_edge;
+
+typedef struct {
+    app_pc                pc;
+    int                   opcode;
+    int                   latency;
+    int                   start;    /* earliest issue cycle, dataflow only */
+    bool                  fused;    /* macro-fused with the previous node */
+    uint8_t               mix;      /* MIX_* class */
+    std::vector<uint16_t> uops;     /* port mask of each uop */
+    std::vector<dep_edge> preds;
+    std::vector<dep_edge> anti;     /* WAR: exported, not part of timing */
+    std::vector<uint16_t> src_res;  /* RAW resources, see RES_FLAG */
+    std::vector<uint16_t> dst_res;
+    std::vector<uint8_t>  mem_srcs; /* captured-address slots */
+    std::vector<uint8_t>  mem_dsts;
+    uint8_t               value_slot;   /* VALUE_SLOT_NONE: not captured */
+    uint16_t              value_res;    /* register whose value it holds */
+} dep_node;
+
+typedef std::vector<dep_node> dep_graph;
+
+/* Dependencies the hardware enforces but the graph leaves out: a write
+ * to part of a register merging into the rest of it (and a wider read
+ * after such a write), scalar SSE results merging into the old upper
+ * lanes of their destination, and the output dependency of popcnt,
+ * lzcnt and tzcnt.
+ */
+enum {
+    FALSE_PARTIAL,
+    FALSE_MERGE,
+    FALSE_OUTPUT,
+};
+
+typedef struct {
+    int      from;
+    int      to;
+    reg_id_t reg;
+    uint8_t  reason;    /* FALSE_* */
+} false_dep;
+
+#endif /* ILP_DEPGRAPH_H */
@@ -0,0 +1,1384 @@
+#include "dynamic.h"
+#include "drutil.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <unordered_map>
+
+using namespace std;
+
+/* Limit study after Wall: registers are perfectly renamed, so only true
+ * (RAW) dependencies through registers, flags and exact memory words
+ * constrain issue.  A window of W instructions is modelled as a reorder
+ * buffer: instruction k enters it once instruction k - W has retired, and
+ * retirement is in order.  After a mispredicted branch nothing issues
+ * before the branch itself has executed.
+ */
+typedef struct {
+    int              size;          /* 0: unlimited */
+    vector<uint64_t> retired;       /* retire cycle of the last size instrs */
+    uint64_t         last_retire;
+    uint64_t         finish;
+    uint64_t         count;
+    uint64_t         fence;         /* resolution of the last mispredict */
+    uint64_t         reg_ready[NUM_RESOURCES];  /* ST by physical register */
+    int              x87_top;
+    unordered_map<ptr_uint_t, uint64_t> mem_ready;
+    unordered_map<uint64_t, uint32_t>   load_issue; /* loads per cycle */
+    uint64_t         loads;
+    uint64_t         load_cycles;   /* cycles with a load, flushed */
+    uint32_t         mlp_peak;
+} window_state;
+
+typedef struct {
+    uint64_t execs;
+    uint64_t misses;
+} branch_stats;
+
+typedef unordered_map<app_pc, branch_stats> branch_map;
+
+typedef struct {
+    uint64_t served[CACHE_LEVELS + 1];  /* accesses served by each level */
+    uint64_t execs;
+    double   sum_ilp;                   /* per-execution ILP with misses */
+} cache_stats;
+
+typedef unordered_map<const block_info*, cache_stats> cache_map;
+
+/* Stride profiling samples bursts of STRIDE_BURST consecutive blocks out
+ * of every STRIDE_PERIOD, so back-to-back executions of a load are still
+ * seen together without recording every access.  Samples are buffered
+ * per thread and folded into per-load statistics when the buffer fills.
+ * Only the first memory source of an instruction is profiled.
+ */
+#define STRIDE_PERIOD 1024
+#define STRIDE_BURST  128
+#define STRIDE_BUFFER 4096
+#define STRIDE_TOP    4     /* distinct strides tracked per load */
+
+/* A dominant stride covering this share of a load's samples makes it
+ * constant-stride (or same-address, for stride 0).
+ */
+#define STRIDE_DOMINANT 0.9
+
+typedef struct {
+    app_pc pc;      /* NULL: a new burst starts */
+    app_pc addr;
+} stride_sample;
+
+typedef struct {
+    uint64_t  samples;
+    ptr_int_t strides[STRIDE_TOP];
+    uint64_t  counts[STRIDE_TOP];
+    uint64_t  other;                /* strides beyond the first few */
+} stride_stats;
+
+typedef unordered_map<app_pc, stride_stats> stride_map;
+
+/* Value prediction runs in the same kind of bursts as stride sampling;
+ * only the sampled blocks are replayed, with and without prediction.
+ */
+#define VALUE_PERIOD  1024
+#define VALUE_BURST   128
+
+typedef struct {
+    ptr_uint_t last;
+    ptr_int_t  stride;
+    uint64_t   burst;       /* last and stride are from this burst */
+} value_history;
+
+typedef struct {
+    uint64_t samples;       /* executions with a history to predict from */
+    uint64_t last_hits;
+    uint64_t stride_hits;
+    uint64_t predicted;     /* either predictor right */
+} value_stats;
+
+typedef unordered_map<app_pc, value_stats> value_map;
+
+/* Stores still in the store buffer when a later load issues; a load whose
+ * address matches one of them in bits 11:0 but not above is 4K-aliased.
+ * A load overlapping the youngest such store without lying inside it
+ * cannot be forwarded and waits for the store to commit.
+ */
+#define STORE_BUFFER  32
+#define LINE_BYTES    (1 << CACHE_LINE_BITS)
+#define PAGE_MASK_4K  0xfff
+#define FORWARD_STALL 12    /* extra cycles of a failed store forward */
+
+typedef struct {
+    app_pc     pc;
+    ptr_uint_t addr;
+    int        size;
+} store_entry;
+
+typedef struct {
+    uint64_t         execs;
+    vector<uint64_t> splits;    /* per node */
+    vector<uint64_t> aliases;
+} hazard_stats;
+
+typedef unordered_map<const block_info*, hazard_stats> hazard_map;
+
+typedef struct {
+    uint64_t stalls;
+    int      store_size;
+    int      load_size;
+} forward_stats;
+
+/* Keyed by (store pc, load pc) */
+typedef map<pair<app_pc, app_pc>, forward_stats> forward_map;
+
+typedef struct {
+    vector<window_state> windows;
+    bpred_state*         bp;
+    branch_map           branches;
+    cache_sim*           cache;
+    cache_map            cache_blocks;
+    vector<int>          extra;     /* miss and forwarding latency */
+    vector<int>          finish;
+    uint64_t             blocks;    /* replayed, for stride sampling */
+    vector<stride_sample> samples;
+    unordered_map<app_pc, app_pc> last_addr;
+    stride_map           strides;
+    store_entry          stores[STORE_BUFFER];
+    uint64_t             num_stores;
+    hazard_map           hazards;
+    forward_map          forwards;
+    uint64_t             loads;     /* checked for forwarding */
+    uint64_t             value_blocks;
+    unordered_map<app_pc, value_history> history;
+    value_map            values;
+    vector<char>         predicted; /* per pending node */
+    vector<window_state> vp_base;   /* sampled blocks, no prediction */
+    vector<window_state> vp_windows;
+} thread_state;
+
+/* Plain layout: inline code addresses addrs[] and values[] at fixed
+ * offsets
+ */
+typedef struct {
+    app_pc            addrs[MAX_MEM_SLOTS];
+    ptr_uint_t        values[MAX_VALUE_SLOTS];
+    void*             capture;      /* this struct in a burst, or NULL */
+    const block_info* pending;      /* block whose addresses are in addrs */
+    thread_state*     state;
+} per_thread;
+
+typedef struct {
+    uint64_t count;
+    uint64_t cycles;
+    uint64_t loads;
+    uint64_t load_cycles;
+    uint32_t mlp_peak;
+} window_totals;
+
+static dynamic_config config;
+static vector<window_totals> totals;
+static branch_map branches;
+static cache_map cache_blocks;
+static stride_map strides;
+static hazard_map hazards;
+static forward_map forwards;
+static uint64_t forward_loads;
+static value_map values;
+static vector<window_totals> vp_base_totals;
+static vector<window_totals> vp_totals;
+static void* totals_mutex;
+
+void
+collect_mem_refs(instr_t* instr, vector<mem_ref>& refs)
+{
+    if (instr_reads_memory(instr))
+    {
+        for (int i = 0; i < instr_num_srcs(instr); ++i)
+        {
+            opnd_t opnd = instr_get_src(instr, i);
+            if (!opnd_is_memory_reference(opnd))
+                continue;
+            mem_ref ref = { opnd, true, false };
+            refs.push_back(ref);
+        }
+    }
+
+    if (instr_writes_memory(instr))
+    {
+        for (int i = 0; i < instr_num_dsts(instr); ++i)
+        {
+            opnd_t opnd = instr_get_dst(instr, i);
+            if (!opnd_is_memory_reference(opnd))
+                continue;
+
+            bool merged = false;
+            for (vector<mem_ref>::iterator it = refs.begin();
+                 it != refs.end() && !merged; ++it)
+            {
+                if (opnd_same_address(it->opnd, opnd))
+                {
+                    it->write = true;
+                    merged = true;
+                }
+            }
+            if (!merged)
+            {
+                mem_ref ref = { opnd, false, true };
+                refs.push_back(ref);
+            }
+        }
+    }
+}
+
+reg_id_t
+value_reg(instr_t* instr)
+{
+    /* Nothing to capture after control transfers or at the end of the
+     * block, where the next block's entry code runs instead
+     */
+    if (instr_is_cti(instr) || instr_is_syscall(instr)
+        || instr_is_interrupt(instr) || instr_get_next(instr) == NULL)
+        return DR_REG_NULL;
+    for (int i = 0; i < instr_num_dsts(instr); ++i)
+    {
+        opnd_t opnd = instr_get_dst(instr, i);
+        if (opnd_is_reg(opnd) && reg_is_gpr(opnd_get_reg(opnd)))
+            return opnd_get_reg(opnd);
+    }
+    return DR_REG_NULL;
+}
+
+/* Window sizes of the value-prediction replays */
+static vector<int>
+vp_sizes(void)
+{
+    if (config.windows.empty())
+        return vector<int>(1, 0);
+    return config.windows;
+}
+
+static void
+init_window(window_state& w, int size)
+{
+    w.size = size;
+    w.retired.assign(w.size, 0);
+    w.last_retire = w.finish = w.count = w.fence = 0;
+    w.loads = w.load_cycles = 0;
+    w.mlp_peak = 0;
+    w.x87_top = 0;
+    memset(w.reg_ready, 0, sizeof(w.reg_ready));
+}
+
+void
+dynamic_init(const dynamic_config& cfg)
+{
+    config = cfg;
+    totals.assign(config.windows.size(), window_totals());
+    if (config.values)
+    {
+        vp_base_totals.assign(vp_sizes().size(), window_totals());
+        vp_totals.assign(vp_sizes().size(), window_totals());
+    }
+    totals_mutex = dr_mutex_create();
+    drutil_init();
+}
+
+void
+dynamic_exit(void)
+{
+    drutil_exit();
+    dr_mutex_destroy(totals_mutex);
+}
+
+void
+dynamic_thread_init(void* dc)
+{
+    per_thread* pt = (per_thread*) dr_thread_alloc(dc, sizeof(per_thread));
+    memset(pt, 0, sizeof(*pt));
+
+    pt->state = new thread_state();
+    pt->state->windows.resize(config.windows.size());
+    for (size_t i = 0; i < config.windows.size(); ++i)
+        init_window(pt->state->windows[i], config.windows[i]);
+    if (config.values)
+    {
+        vector<int> sizes = vp_sizes();
+        pt->state->vp_base.resize(sizes.size());
+        pt->state->vp_windows.resize(sizes.size());
+        for (size_t i = 0; i < sizes.size(); ++i)
+        {
+            init_window(pt->state->vp_base[i], sizes[i]);
+            init_window(pt->state->vp_windows[i], sizes[i]);
+        }
+    }
+    pt->state->bp = bpred_create(config.bpred);
+    if (config.cache)
+    {
+        pt->state->cache = new cache_sim();
+        cache_init(pt->state->cache, config.levels);
+    }
+    dr_set_tls_field(dc, pt);
+}
+
+static inline ptr_uint_t
+mem_key(const per_thread* pt, uint8_t slot)
+{
+    /* Addresses beyond the captured slots all collide on one key */
+    if (slot == MEM_SLOT_UNKNOWN)
+        return 0;
+    return (ptr_uint_t) pt->addrs[slot] >> 3;
+}
+
+/* Runs the pending block through the caches, recording the extra
+ * latency of every load that missed L1 (the serving level's latency less
+ * L1's, as the static load latency covers a hit) and the block's own
+ * critical path under those latencies (store-forwarding stalls are added
+ * afterwards).
+ */
+static void
+simulate_cache(per_thread* pt)
+{
+    thread_state* ts = pt->state;
+    const dep_graph& graph = pt->pending->graph;
+    cache_stats& stats = ts->cache_blocks[pt->pending];
+    int n = (int) graph.size();
+    int nc = 0;
+
+    ts->finish.resize(n);
+    for (int i = 0; i < n; ++i)
+    {
+        const dep_node& node = graph[i];
+        for (vector<uint8_t>::const_iterator it = node.mem_srcs.begin();
+             it != node.mem_srcs.end(); ++it)
+        {
+            if (*it == MEM_SLOT_UNKNOWN)
+                continue;
+            int level = cache_access(ts->cache, (ptr_uint_t) pt->addrs[*it]);
+            int latency = (level == CACHE_MEMORY)
+                ? config.mem_latency : config.levels[level].latency;
+            stats.served[level]++;
+            ts->extra[i] = max(ts->extra[i],
+                               latency - config.levels[0].latency);
+        }
+
+        /* Stores allocate too; read-modify-write operands were counted above */
+        for (vector<uint8_t>::const_iterator it = node.mem_dsts.begin();
+             it != node.mem_dsts.end(); ++it)
+        {
+            if (*it == MEM_SLOT_UNKNOWN
+                || find(node.mem_srcs.begin(), node.mem_srcs.end(), *it)
+                   != node.mem_srcs.end())
+                continue;
+            stats.served[cache_access(ts->cache,
+                                      (ptr_uint_t) pt->addrs[*it])]++;
+        }
+
+        int start = 0;
+        for (vector<dep_edge>::const_iterator it = node.preds.begin();
+             it != node.preds.end(); ++it)
+            start = max(start, ts->finish[it->from]);
+        ts->finish[i] = start + node.latency + ts->extra[i];
+        nc = max(nc, ts->finish[i]);
+    }
+
+    stats.execs++;
+    if (nc > 0)
+        stats.sum_ilp += (double) n / nc;
+}
+
+/* Folds the per-cycle load counts below `bound' into the totals.  In a
+ * finite window nothing issues before the retirement of the instruction
+ * it replaces, so once that has passed those cycles are final.
+ */
+static void
+flush_loads(window_state& w, uint64_t bound)
+{
+    for (unordered_map<uint64_t, uint32_t>::iterator it =
+             w.load_issue.begin(); it != w.load_issue.end(); )
+    {
+        if (it->first >= bound)
+        {
+            ++it;
+            continue;
+        }
+        w.load_cycles++;
+        w.mlp_peak = max(w.mlp_peak, it->second);
+        it = w.load_issue.erase(it);
+    }
+}
+
+/* Blocks name ST registers by their stack position at block entry; the
+ * window keeps them by physical register, from its own top of stack.
+ */
+static inline uint16_t
+physical_res(const window_state& w, uint16_t res)
+{
+    if (res < DR_REG_ST0 || res > DR_REG_ST7)
+        return res;
+    return (uint16_t) (DR_REG_ST0 + ((w.x87_top + res - DR_REG_ST0) & 7));
+}
+
+/* Moves each value to the register fxch left it in and pops or pushes
+ * the window's top of stack as block did, or sets it if block ran fninit.
+ */
+static void
+x87_exit(window_state& w, const block_info* block)
+{
+    if (block->mix_ni[MIX_X87] == 0)
+        return;
+    uint64_t ready[8];
+    for (int i = 0; i < 8; ++i)
+        ready[i] = w.reg_ready[DR_REG_ST0
+                               + ((w.x87_top + block->x87_slot[i]) & 7)];
+    int base = block->x87_init ? 0 : w.x87_top;
+    for (int i = 0; i < 8; ++i)
+        w.reg_ready[DR_REG_ST0 + ((base + i) & 7)] = ready[i];
+    w.x87_top = (base + block->x87_top) & 7;
+}
+
+/* With predicted set, the value of every node flagged in it is known when
+ * the node enters the window, so its consumers need not wait for it.
+ */
+static void
+replay_window(const per_thread* pt, window_state& w, const block_info* block,
+              bool mispredicted, const vector<char>* predicted)
+{
+    const dep_graph& graph = block->graph;
+    const vector<int>& extra = pt->state->extra;
+    uint64_t done = 0;
+    for (dep_graph::const_iterator node = graph.begin();
+         node != graph.end(); ++node)
+    {
+        uint64_t t = w.fence;
+        size_t pos = 0;
+        if (w.size > 0)
+        {
+            pos = w.count % w.size;
+            if (w.retired[pos] > t)
+                t = w.retired[pos];
+        }
+        uint64_t enter = t;
+
+        for (vector<uint16_t>::const_iterator it = node->src_res.begin();
+             it != node->src_res.end(); ++it)
+        {
+            if (w.reg_ready[physical_res(w, *it)] > t)
+                t = w.reg_ready[physical_res(w, *it)];
+        }
+        for (vector<uint8_t>::const_iterator it = node->mem_srcs.begin();
+             it != node->mem_srcs.end(); ++it)
+        {
+            unordered_map<ptr_uint_t, uint64_t>::const_iterator ready =
+                w.mem_ready.find(mem_key(pt, *it));
+            if (ready != w.mem_ready.end() && ready->second > t)
+                t = ready->second;
+        }
+
+        if (config.mlp && w.size > 0 && !node->mem_srcs.empty())
+        {
+            w.loads++;
+            w.load_issue[t]++;
+        }
+
+        done = t + node->latency;
+        if (!extra.empty())
+            done += extra[node - graph.begin()];
+        bool known = predicted != NULL && (*predicted)[node - graph.begin()];
+        for (vector<uint16_t>::const_iterator it = node->dst_res.begin();
+             it != node->dst_res.end(); ++it)
+            w.reg_ready[physical_res(w, *it)] =
+                (known && *it == node->value_res) ? enter : done;
+        for (vector<uint8_t>::const_iterator it = node->mem_dsts.begin();
+             it != node->mem_dsts.end(); ++it)
+            w.mem_ready[mem_key(pt, *it)] = done;
+
+        if (done > w.finish)
+            w.finish = done;
+        if (done > w.last_retire)
+            w.last_retire = done;
+        if (w.size > 0)
+            w.retired[pos] = w.last_retire;
+        w.count++;
+    }
+
+    x87_exit(w, block);
+
+    /* The branch closes the block, so it is the last node */
+    if (mispredicted)
+        w.fence = done;
+
+    if (w.size > 0 && w.load_issue.size() > 4 * (size_t) w.size)
+        flush_loads(w, w.retired[w.count % w.size]);
+}
+
+static void
+add_stride(stride_stats& stats, ptr_int_t stride, uint64_t count)
+{
+    stats.samples += count;
+    for (int i = 0; i < STRIDE_TOP; ++i)
+    {
+        if (stats.counts[i] == 0)
+            stats.strides[i] = stride;
+        if (stats.strides[i] == stride)
+        {
+            stats.counts[i] += count;
+            return;
+        }
+    }
+    stats.other += count;
+}
+
+static void
+flush_strides(thread_state* ts)
+{
+    for (vector<stride_sample>::const_iterator it = ts->samples.begin();
+         it != ts->samples.end(); ++it)
+    {
+        if (it->pc == NULL)
+        {
+            ts->last_addr.clear();
+            continue;
+        }
+        unordered_map<app_pc, app_pc>::iterator last =
+            ts->last_addr.find(it->pc);
+        if (last != ts->last_addr.end())
+        {
+            add_stride(ts->strides[it->pc], it->addr - last->second, 1);
+            last->second = it->addr;
+        }
+        else
+            ts->last_addr[it->pc] = it->addr;
+    }
+    ts->samples.clear();
+}
+
+static void
+sample_strides(per_thread* pt)
+{
+    thread_state* ts = pt->state;
+    uint64_t phase = ts->blocks++ % STRIDE_PERIOD;
+    if (phase >= STRIDE_BURST)
+        return;
+    if (phase == 0)
+    {
+        stride_sample burst = { NULL, NULL };
+        ts->samples.push_back(burst);
+    }
+
+    const dep_graph& graph = pt->pending->graph;
+    for (dep_graph::const_iterator node = graph.begin();
+         node != graph.end(); ++node)
+    {
+        if (node->mem_srcs.empty() || node->mem_srcs[0] == MEM_SLOT_UNKNOWN)
+            continue;
+        stride_sample sample = { node->pc, pt->addrs[node->mem_srcs[0]] };
+        ts->samples.push_back(sample);
+    }
+    if (ts->samples.size() >= STRIDE_BUFFER)
+        flush_strides(ts);
+}
+
+/* Runs the last-value and stride predictors over the captured values of
+ * the pending block if it falls in a sampling burst, flagging the nodes
+ * either of them got right.
+ */
+static bool
+predict_values(per_thread* pt)
+{
+    thread_state* ts = pt->state;
+    uint64_t n = ts->value_blocks++;
+    if (n % VALUE_PERIOD >= VALUE_BURST)
+        return false;
+    uint64_t burst = n / VALUE_PERIOD + 1;
+
+    const dep_graph& graph = pt->pending->graph;
+    ts->predicted.assign(graph.size(), 0);
+    for (size_t i = 0; i < graph.size(); ++i)
+    {
+        if (graph[i].value_slot == VALUE_SLOT_NONE)
+            continue;
+        ptr_uint_t value = pt->values[graph[i].value_slot];
+        value_history& history = ts->history[graph[i].pc];
+        if (history.burst == burst)
+        {
+            value_stats& stats = ts->values[graph[i].pc];
+            bool last = (value == history.last);
+            bool stride = (value == history.last + history.stride);
+            stats.samples++;
+            if (last)
+                stats.last_hits++;
+            if (stride)
+                stats.stride_hits++;
+            if (last || stride)
+            {
+                stats.predicted++;
+                ts->predicted[i] = 1;
+            }
+            history.stride = value - history.last;
+        }
+        else
+        {
+            history.burst = burst;
+            history.stride = 0;
+        }
+        history.last = value;
+    }
+    return true;
+}
+
+static inline bool
+splits_line(ptr_uint_t addr, int size)
+{
+    return (addr & (LINE_BYTES - 1)) + size > LINE_BYTES;
+}
+
+static inline bool
+overlaps(ptr_uint_t a, int a_size, ptr_uint_t b, int b_size)
+{
+    return a < b + b_size && b < a + a_size;
+}
+
+/* Overlap in the low 12 bits without being the same bytes */
+static inline bool
+aliases_4k(ptr_uint_t load, int load_size, const store_entry& store)
+{
+    return overlaps(load & PAGE_MASK_4K, load_size,
+                    store.addr & PAGE_MASK_4K, store.size)
+        && (load >> 12) != (store.addr >> 12);
+}
+
+/* Checks one load against the store buffer: the youngest overlapping
+ * store has to cover the whole load for its data to be forwarded.
+ */
+static void
+check_load(thread_state* ts, app_pc pc, ptr_uint_t addr, int size,
+           bool& aliased, bool& stalled)
+{
+    uint64_t first = (ts->num_stores > STORE_BUFFER)
+        ? ts->num_stores - STORE_BUFFER : 0;
+    aliased = stalled = false;
+    for (uint64_t s = ts->num_stores; s > first; --s)
+    {
+        const store_entry& store = ts->stores[(s - 1) % STORE_BUFFER];
+        if (overlaps(addr, size, store.addr, store.size))
+        {
+            stalled = addr < store.addr
+                || addr + size > store.addr + store.size;
+            if (stalled)
+            {
+                forward_stats& stats = ts->forwards[make_pair(store.pc, pc)];
+                stats.stalls++;
+                stats.store_size = store.size;
+                stats.load_size = size;
+            }
+            return;
+        }
+        if (aliases_4k(addr, size, store))
+            aliased = true;
+    }
+}
+
+/* Replays the pending block's accesses against the store buffer for
+ * line splits, 4K aliasing and failed store forwarding.
+ */
+static void
+check_memory(per_thread* pt)
+{
+    thread_state* ts = pt->state;
+    const block_info* info = pt->pending;
+    const dep_graph& graph = info->graph;
+    hazard_stats* stats = NULL;
+    if (config.hazards)
+    {
+        stats = &ts->hazards[info];
+        if (stats->execs++ == 0)
+        {
+            stats->splits.assign(graph.size(), 0);
+            stats->aliases.assign(graph.size(), 0);
+        }
+    }
+
+    for (size_t i = 0; i < graph.size(); ++i)
+    {
+        const dep_node& node = graph[i];
+        for (vector<uint8_t>::const_iterator it = node.mem_srcs.begin();
+             it != node.mem_srcs.end(); ++it)
+        {
+            if (*it == MEM_SLOT_UNKNOWN)
+                continue;
+            ptr_uint_t addr = (ptr_uint_t) pt->addrs[*it];
+            int size = info->slot_sizes[*it];
+            bool aliased, stalled;
+            check_load(ts, node.pc, addr, size, aliased, stalled);
+            if (stats != NULL)
+            {
+                if (splits_line(addr, size))
+                    stats->splits[i]++;
+                if (aliased)
+                    stats->aliases[i]++;
+            }
+            if (config.forwarding)
+            {
+                ts->loads++;
+                if (stalled)
+                    ts->extra[i] += FORWARD_STALL;
+            }
+        }
+        for (vector<uint8_t>::const_iterator it = node.mem_dsts.begin();
+             it != node.mem_dsts.end(); ++it)
+        {
+            if (*it == MEM_SLOT_UNKNOWN)
+                continue;
+            store_entry store = { node.pc, (ptr_uint_t) pt->addrs[*it],
+                                  info->slot_sizes[*it] };
+            if (stats != NULL
+                && find(node.mem_srcs.begin(), node.mem_srcs.end(), *it)
+                   == node.mem_srcs.end()
+                && splits_line(store.addr, store.size))
+                stats->splits[i]++;
+            ts->stores[ts->num_stores++ % STORE_BUFFER] = store;
+        }
+    }
+}
+
+static void
+replay_pending(per_thread* pt, bool mispredicted)
+{
+    if (pt->pending == NULL)
+        return;
+    if (config.stride)
+        sample_strides(pt);
+    if (pt->state->cache != NULL || config.forwarding)
+        pt->state->extra.assign(pt->pending->graph.size(), 0);
+    if (pt->state->cache != NULL)
+        simulate_cache(pt);
+    if (config.hazards || config.forwarding)
+        check_memory(pt);
+    for (size_t i = 0; i < pt->state->windows.size(); ++i)
+    {
+        replay_window(pt, pt->state->windows[i], pt->pending,
+                      mispredicted, NULL);
+    }
+    if (config.values && predict_values(pt))
+    {
+        thread_state* ts = pt->state;
+        for (size_t i = 0; i < ts->vp_windows.size(); ++i)
+        {
+            replay_window(pt, ts->vp_base[i], pt->pending,
+                          mispredicted, NULL);
+            replay_window(pt, ts->vp_windows[i], pt->pending,
+                          mispredicted, &ts->predicted);
+        }
+    }
+    pt->pending = NULL;
+}
+
+void
+dynamic_thread_exit(void* dc)
+{
+    per_thread* pt = (per_thread*) dr_get_tls_field(dc);
+    replay_pending(pt, false);
+
+    dr_mutex_lock(totals_mutex);
+    for (size_t i = 0; i < pt->state->windows.size(); ++i)
+    {
+        window_state& w = pt->state->windows[i];
+        flush_loads(w, UINT64_MAX);
+        totals[i].count += w.count;
+        totals[i].cycles += w.finish;
+        totals[i].loads += w.loads;
+        totals[i].load_cycles += w.load_cycles;
+        totals[i].mlp_peak = max(totals[i].mlp_peak, w.mlp_peak);
+    }
+    for (size_t i = 0; i < pt->state->vp_windows.size(); ++i)
+    {
+        vp_base_totals[i].count += pt->state->vp_base[i].count;
+        vp_base_totals[i].cycles += pt->state->vp_base[i].finish;
+        vp_totals[i].count += pt->state->vp_windows[i].count;
+        vp_totals[i].cycles += pt->state->vp_windows[i].finish;
+    }
+    for (value_map::const_iterator it = pt->state->values.begin();
+         it != pt->state->values.end(); ++it)
+    {
+        value_stats& stats = values[it->first];
+        stats.samples += it->second.samples;
+        stats.last_hits += it->second.last_hits;
+        stats.stride_hits += it->second.stride_hits;
+        stats.predicted += it->second.predicted;
+    }
+    for (branch_map::const_iterator it = pt->state->branches.begin();
+         it != pt->state->branches.end(); ++it)
+    {
+        branches[it->first].execs += it->second.execs;
+        branches[it->first].misses += it->second.misses;
+    }
+    for (cache_map::const_iterator it = pt->state->cache_blocks.begin();
+         it != pt->state->cache_blocks.end(); ++it)
+    {
+        cache_stats& stats = cache_blocks[it->first];
+        for (int i = 0; i <= CACHE_LEVELS; ++i)
+            stats.served[i] += it->second.served[i];
+        stats.execs += it->second.execs;
+        stats.sum_ilp += it->second.sum_ilp;
+    }
+    for (hazard_map::const_iterator it = pt->state->hazards.begin();
+         it != pt->state->hazards.end(); ++it)
+    {
+        hazard_stats& stats = hazards[it->first];
+        if (stats.execs == 0)
+        {
+            stats.splits.assign(it->second.splits.size(), 0);
+            stats.aliases.assign(it->second.aliases.size(), 0);
+        }
+        stats.execs += it->second.execs;
+        for (size_t i = 0; i < stats.splits.size(); ++i)
+        {
+            stats.splits[i] += it->second.splits[i];
+            stats.aliases[i] += it->second.aliases[i];
+        }
+    }
+    for (forward_map::const_iterator it = pt->state->forwards.begin();
+         it != pt->state->forwards.end(); ++it)
+    {
+        forward_stats& stats = forwards[it->first];
+        stats.stalls += it->second.stalls;
+        stats.store_size = it->second.store_size;
+        stats.load_size = it->second.load_size;
+    }
+    forward_loads += pt->state->loads;
+    flush_strides(pt->state);
+    for (stride_map::const_iterator it = pt->state->strides.begin();
+         it != pt->state->strides.end(); ++it)
+    {
+        stride_stats& stats = strides[it->first];
+        for (int i = 0; i < STRIDE_TOP; ++i)
+        {
+            if (it->second.counts[i] > 0)
+                add_stride(stats, it->second.strides[i], it->second.counts[i]);
+        }
+        stats.samples += it->second.other;
+        stats.other += it->second.other;
+    }
+    dr_mutex_unlock(totals_mutex);
+
+    delete pt->state->cache;
+    bpred_destroy(pt->state->bp);
+    delete pt->state;
+    dr_thread_free(dc, pt, sizeof(per_thread));
+}
+
+/* With strides the only consumer, addresses are only stored for blocks
+ * that sample_strides folds in, gated on capture like values are.
+ */
+static bool
+sampled_addrs(void)
+{
+    return config.stride && config.windows.empty() && !config.cache
+        && !config.hazards && !config.forwarding && !config.values;
+}
+
+/* Called from the clean call at the entry of every block: the previous
+ * block has finished, so its captured addresses are complete, and where
+ * we are now tells which way its closing branch went.
+ */
+void
+dynamic_block(void* dc, const block_info* info)
+{
+    per_thread* pt = (per_thread*) dr_get_tls_field(dc);
+    const block_info* prev = pt->pending;
+    bool mispredicted = false;
+
+    if (prev != NULL && prev->cbr_pc != NULL)
+    {
+        bool taken = (info->start_pc == prev->cbr_target);
+        mispredicted = !bpred_update(pt->state->bp, prev->cbr_pc, taken);
+
+        branch_stats& stats = pt->state->branches[prev->cbr_pc];
+        stats.execs++;
+        if (mispredicted)
+            stats.misses++;
+    }
+
+    replay_pending(pt, mispredicted);
+    pt->pending = info;
+
+    /* Values are only captured for blocks replayed in a burst, and so are
+     * addresses when only strides need them
+     */
+    if (config.values)
+    {
+        pt->capture = (pt->state->value_blocks % VALUE_PERIOD < VALUE_BURST)
+            ? pt : NULL;
+    }
+    else if (sampled_addrs())
+    {
+        pt->capture = (pt->state->blocks % STRIDE_PERIOD < STRIDE_BURST)
+            ? pt : NULL;
+    }
+}
+
+static void
+insert_capture(void* dc, instrlist_t* bb, instr_t* where,
+               opnd_t ref, int slot, bool sampled)
+{
+    /* xcx last, so the address is never in it and jecxz can test it */
+    static const reg_id_t candidates[] = {
+        DR_REG_XAX, DR_REG_XDX, DR_REG_XBX, DR_REG_XCX
+    };
+    reg_id_t regs[2];
+    int found = 0;
+    for (int i = 0; i < 4 && found < 2; ++i)
+    {
+        if (!opnd_uses_reg(ref, candidates[i]))
+            regs[found++] = candidates[i];
+    }
+    reg_id_t addr = regs[0], scratch = regs[1];
+    reg_id_t base = sampled ? DR_REG_XCX : scratch;
+    instr_t* skip = sampled ? INSTR_CREATE_label(dc) : NULL;
+
+    dr_save_reg(dc, bb, where, addr, SPILL_SLOT_2);
+    dr_save_reg(dc, bb, where, scratch, SPILL_SLOT_3);
+    if (base != scratch)
+        dr_save_reg(dc, bb, where, base, SPILL_SLOT_4);
+
+    drutil_insert_get_mem_addr(dc, bb, where, ref, addr, scratch);
+    dr_insert_read_tls_field(dc, bb, where, base);
+    if (sampled)
+    {
+        instrlist_meta_preinsert(bb, where,
+            INSTR_CREATE_mov_ld(dc, opnd_create_reg(base),
+            OPND_CREATE_MEMPTR(base, offsetof(per_thread, capture))));
+        instrlist_meta_preinsert(bb, where,
+            INSTR_CREATE_jecxz(dc, opnd_create_instr(skip)));
+    }
+    instrlist_meta_preinsert(bb, where,
+        INSTR_CREATE_mov_st(dc,
+        OPND_CREATE_MEMPTR(base,
+            offsetof(per_thread, addrs) + slot * sizeof(app_pc)),
+        opnd_create_reg(addr)));
+    if (sampled)
+        instrlist_meta_preinsert(bb, where, skip);
+
+    if (base != scratch)
+        dr_restore_reg(dc, bb, where, base, SPILL_SLOT_4);
+    dr_restore_reg(dc, bb, where, scratch, SPILL_SLOT_3);
+    dr_restore_reg(dc, bb, where, addr, SPILL_SLOT_2);
+}
+
+/* Stores the value of reg, just written by the previous instruction,
+ * when the block will be replayed in a value burst.  capture holds the
+ * per_thread itself then and NULL otherwise, so jecxz both skips the store
+ * outside bursts and leaves its base in xcx, without touching the flags.
+ */
+static void
+insert_value_capture(void* dc, instrlist_t* bb, instr_t* where,
+                     reg_id_t reg, int slot)
+{
+    reg_id_t value = reg_to_pointer_sized(reg);
+    bool in_xcx = (value == DR_REG_XCX);
+    instr_t* skip = INSTR_CREATE_label(dc);
+
+    dr_save_reg(dc, bb, where, DR_REG_XCX, SPILL_SLOT_3);
+    if (in_xcx)
+    {
+        value = DR_REG_XAX;
+        dr_save_reg(dc, bb, where, DR_REG_XAX, SPILL_SLOT_2);
+        instrlist_meta_preinsert(bb, where,
+            INSTR_CREATE_mov_ld(dc, opnd_create_reg(DR_REG_XAX),
+                                opnd_create_reg(DR_REG_XCX)));
+    }
+    dr_insert_read_tls_field(dc, bb, where, DR_REG_XCX);
+    instrlist_meta_preinsert(bb, where,
+        INSTR_CREATE_mov_ld(dc, opnd_create_reg(DR_REG_XCX),
+        OPND_CREATE_MEMPTR(DR_REG_XCX, offsetof(per_thread, capture))));
+    instrlist_meta_preinsert(bb, where,
+        INSTR_CREATE_jecxz(dc, opnd_create_instr(skip)));
+    instrlist_meta_preinsert(bb, where,
+        INSTR_CREATE_mov_st(dc,
+        OPND_CREATE_MEMPTR(DR_REG_XCX,
+            offsetof(per_thread, values) + slot * sizeof(ptr_uint_t)),
+        opnd_create_reg(value)));
+    instrlist_meta_preinsert(bb, where, skip);
+    if (in_xcx)
+        dr_restore_reg(dc, bb, where, DR_REG_XAX, SPILL_SLOT_2);
+    dr_restore_reg(dc, bb, where, DR_REG_XCX, SPILL_SLOT_3);
+}
+
+/* Must run before any other instrumentation is added to the block */
+void
+dynamic_instrument(void* dc, instrlist_t* bb)
+{
+    /* Addresses feed the limit study, caches, strides and hazards */
+    if (config.windows.empty() && !config.cache && !config.stride
+        && !config.hazards && !config.forwarding && !config.values)
+        return;
+
+    int slot = 0, value_slot = 0;
+    bool sampled = sampled_addrs();
+    instr_t* next;
+    for (instr_t* instr = instrlist_first(bb); instr != NULL; instr = next)
+    {
+        next = instr_get_next(instr);
+        vector<mem_ref> refs;
+        collect_mem_refs(instr, refs);
+        for (vector<mem_ref>::const_iterator it = refs.begin();
+             it != refs.end() && slot < MAX_MEM_SLOTS; ++it)
+            insert_capture(dc, bb, instr, it->opnd, slot++, sampled);
+
+        /* Value slots are numbered for every block, captured on request */
+        reg_id_t reg = value_reg(instr);
+        if (reg == DR_REG_NULL || value_slot >= MAX_VALUE_SLOTS)
+            continue;
+        if (config.values)
+            insert_value_capture(dc, bb, next, reg, value_slot);
+        value_slot++;
+    }
+}
+
+static bool
+more_misses(const pair<app_pc, branch_stats>& a,
+            const pair<app_pc, branch_stats>& b)
+{
+    return a.second.misses > b.second.misses;
+}
+
+static void
+report_branches(int top)
+{
+    uint64_t execs = 0, misses = 0;
+    vector< pair<app_pc, branch_stats> > sorted(branches.begin(),
+                                                branches.end());
+    for (size_t i = 0; i < sorted.size(); ++i)
+    {
+        execs += sorted[i].second.execs;
+        misses += sorted[i].second.misses;
+    }
+
+    fprintf(stderr, "bpred=%s mispredict-rate=%.2f%% (%llu/%llu)\n",
+        bpred_name(config.bpred), execs > 0 ? 100.0 * misses / execs : 0.0,
+        (unsigned long long) misses, (unsigned long long) execs);
+
+    sort(sorted.begin(), sorted.end(), more_misses);
+    for (size_t i = 0; i < sorted.size() && (int) i < top; ++i)
+    {
+        const branch_stats& stats = sorted[i].second;
+        if (stats.misses == 0)
+            break;
+        fprintf(stderr, "  %s execs=%llu mispredicts=%llu rate=%.2f%%\n",
+            block_location(sorted[i].first).c_str(),
+            (unsigned long long) stats.execs,
+            (unsigned long long) stats.misses,
+            100.0 * stats.misses / stats.execs);
+    }
+}
+
+static bool
+hotter_block(const pair<const block_info*, cache_stats>& a,
+             const pair<const block_info*, cache_stats>& b)
+{
+    return a.first->exec_count * a.first->ni
+         > b.first->exec_count * b.first->ni;
+}
+
+static void
+print_served(const uint64_t* served)
+{
+    uint64_t total = 0;
+    for (int i = 0; i <= CACHE_LEVELS; ++i)
+        total += served[i];
+    if (total == 0)
+        total = 1;
+    fprintf(stderr, "l1=%.2f%% l2=%.2f%% llc=%.2f%% mem=%.2f%%",
+        100.0 * served[0] / total, 100.0 * served[1] / total,
+        100.0 * served[2] / total, 100.0 * served[3] / total);
+}
+
+static void
+report_cache(int top)
+{
+    uint64_t served[CACHE_LEVELS + 1] = { 0 };
+    double sum_ilp = 0, sum_ni = 0;
+    vector< pair<const block_info*, cache_stats> > sorted(
+        cache_blocks.begin(), cache_blocks.end());
+    for (size_t i = 0; i < sorted.size(); ++i)
+    {
+        const cache_stats& stats = sorted[i].second;
+        for (int j = 0; j <= CACHE_LEVELS; ++j)
+            served[j] += stats.served[j];
+        sum_ilp += stats.sum_ilp * sorted[i].first->ni;
+        sum_ni += (double) stats.execs * sorted[i].first->ni;
+    }
+
+    /* Earlier descriptions had misses pay the full level latency */
+    fprintf(stderr, "cache-miss-latency=level-minus-l1\n");
+    fprintf(stderr, "cache-served ");
+    print_served(served);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "ilp-cache=%.4f\n", sum_ni > 0 ? sum_ilp / sum_ni : 0.0);
+
+    sort(sorted.begin(), sorted.end(), hotter_block);
+    for (size_t i = 0; i < sorted.size() && (int) i < top; ++i)
+    {
+        const block_info* info = sorted[i].first;
+        const cache_stats& stats = sorted[i].second;
+        fprintf(stderr, "  %s ni=%d ilp=%.3f ilp-cache=%.3f ",
+            block_location(info->start_pc).c_str(), info->ni,
+            (double) info->ilp / 1000,
+            stats.execs > 0 ? stats.sum_ilp / stats.execs : 0.0);
+        print_served(stats.served);
+        fprintf(stderr, "\n");
+    }
+}
+
+static bool
+more_samples(const pair<app_pc, stride_stats>& a,
+             const pair<app_pc, stride_stats>& b)
+{
+    return a.second.samples > b.second.samples;
+}
+
+/* Index of the most frequent stride */
+static int
+dominant_stride(const stride_stats& stats)
+{
+    int best = 0;
+    for (int i = 1; i < STRIDE_TOP; ++i)
+    {
+        if (stats.counts[i] > stats.counts[best])
+            best = i;
+    }
+    return best;
+}
+
+static const char*
+stride_pattern(const stride_stats& stats)
+{
+    int best = dominant_stride(stats);
+    if (stats.counts[best] < STRIDE_DOMINANT * stats.samples)
+        return "irregular";
+    return (stats.strides[best] == 0) ? "same-address" : "constant";
+}
+
+static void
+report_strides(int top)
+{
+    vector< pair<app_pc, stride_stats> > sorted(strides.begin(),
+                                                strides.end());
+    uint64_t total = 0, same = 0, constant = 0;
+    for (size_t i = 0; i < sorted.size(); ++i)
+    {
+        const stride_stats& stats = sorted[i].second;
+        const char* pattern = stride_pattern(stats);
+        total += stats.samples;
+        if (strcmp(pattern, "same-address") == 0)
+            same += stats.samples;
+        else if (strcmp(pattern, "constant") == 0)
+            constant += stats.samples;
+    }
+    if (total == 0)
+        return;
+
+    fprintf(stderr, "stride-sampled=%llu same-address=%.2f%% "
+        "constant=%.2f%% irregular=%.2f%%\n", (unsigned long long) total,
+        100.0 * same / total, 100.0 * constant / total,
+        100.0 * (total - same - constant) / total);
+
+    sort(sorted.begin(), sorted.end(), more_samples);
+    for (size_t i = 0; i < sorted.size() && (int) i < top; ++i)
+    {
+        const stride_stats& stats = sorted[i].second;
+        fprintf(stderr, "  %s samples=%llu %s strides=",
+            block_location(sorted[i].first).c_str(),
+            (unsigned long long) stats.samples, stride_pattern(stats));
+        for (int j = 0; j < STRIDE_TOP && stats.counts[j] > 0; ++j)
+            fprintf(stderr, "%s%+ld:%.1f%%", j == 0 ? "" : ",",
+                (long) stats.strides[j],
+                100.0 * stats.counts[j] / stats.samples);
+        if (stats.other > 0)
+            fprintf(stderr, ",other:%.1f%%",
+                100.0 * stats.other / stats.samples);
+        fprintf(stderr, "\n");
+    }
+}
+
+static bool
+hotter_hazards(const pair<const block_info*, hazard_stats>& a,
+               const pair<const block_info*, hazard_stats>& b)
+{
+    return a.first->exec_count * a.first->ni
+         > b.first->exec_count * b.first->ni;
+}
+
+static void
+report_hazards(int top)
+{
+    uint64_t accesses = 0, splits = 0, aliases = 0, total_ni = 0;
+    vector< pair<const block_info*, hazard_stats> > sorted(hazards.begin(),
+                                                           hazards.end());
+    for (size_t i = 0; i < sorted.size(); ++i)
+    {
+        const block_info* info = sorted[i].first;
+        const hazard_stats& stats = sorted[i].second;
+        total_ni += info->exec_count * info->ni;
+        accesses += stats.execs * info->slot_sizes.size();
+        for (size_t j = 0; j < stats.splits.size(); ++j)
+        {
+            splits += stats.splits[j];
+            aliases += stats.aliases[j];
+        }
+    }
+    if (accesses == 0)
+        return;
+
+    fprintf(stderr, "line-splits=%.4f%% 4k-aliases=%.4f%% of accesses\n",
+        100.0 * splits / accesses, 100.0 * aliases / accesses);
+
+    sort(sorted.begin(), sorted.end(), hotter_hazards);
+    for (size_t i = 0; i < sorted.size() && (int) i < top; ++i)
+    {
+        const block_info* info = sorted[i].first;
+        const hazard_stats& stats = sorted[i].second;
+        fprintf(stderr, "  %s ni=%d exec=%llu share=%.2f%%\n",
+            block_location(info->start_pc).c_str(), info->ni,
+            (unsigned long long) info->exec_count,
+            100.0 * info->exec_count * info->ni / total_ni);
+        for (size_t j = 0; j < stats.splits.size(); ++j)
+        {
+            if (stats.splits[j] == 0 && stats.aliases[j] == 0)
+                continue;
+            fprintf(stderr, "    " PFX " splits=%.2f%% 4k-aliases=%.2f%%\n",
+                info->graph[j].pc, 100.0 * stats.splits[j] / stats.execs,
+                100.0 * stats.aliases[j] / stats.execs);
+        }
+    }
+}
+
+static bool
+more_stalls(const pair<pair<app_pc, app_pc>, forward_stats>& a,
+            const pair<pair<app_pc, app_pc>, forward_stats>& b)
+{
+    return a.second.stalls > b.second.stalls;
+}
+
+static void
+report_forwards(int top)
+{
+    uint64_t stalls = 0;
+    vector< pair<pair<app_pc, app_pc>, forward_stats> >
+        sorted(forwards.begin(), forwards.end());
+    for (size_t i = 0; i < sorted.size(); ++i)
+        stalls += sorted[i].second.stalls;
+    if (forward_loads == 0)
+        return;
+
+    fprintf(stderr, "forward-stalls=%llu (%.4f%% of loads) "
+        "stall-cycles=%llu\n", (unsigned long long) stalls,
+        100.0 * stalls / forward_loads,
+        (unsigned long long) stalls * FORWARD_STALL);
+
+    sort(sorted.begin(), sorted.end(), more_stalls);
+    for (size_t i = 0; i < sorted.size() && (int) i < top; ++i)
+    {
+        const forward_stats& stats = sorted[i].second;
+        fprintf(stderr, "  store %s size=%d -> load %s size=%d stalls=%llu\n",
+            block_location(sorted[i].first.first).c_str(), stats.store_size,
+            block_location(sorted[i].first.second).c_str(), stats.load_size,
+            (unsigned long long) stats.stalls);
+    }
+}
+
+static bool
+more_values(const pair<app_pc, value_stats>& a,
+            const pair<app_pc, value_stats>& b)
+{
+    return a.second.samples > b.second.samples;
+}
+
+static void
+report_values(int top)
+{
+    value_stats all = { 0, 0, 0, 0 };
+    vector< pair<app_pc, value_stats> > sorted(values.begin(), values.end());
+    for (size_t i = 0; i < sorted.size(); ++i)
+    {
+        all.samples += sorted[i].second.samples;
+        all.last_hits += sorted[i].second.last_hits;
+        all.stride_hits += sorted[i].second.stride_hits;
+        all.predicted += sorted[i].second.predicted;
+    }
+    if (all.samples == 0)
+        return;
+
+    fprintf(stderr, "value-sampled=%llu last-value=%.2f%% stride=%.2f%% "
+        "predictable=%.2f%%\n", (unsigned long long) all.samples,
+        100.0 * all.last_hits / all.samples,
+        100.0 * all.stride_hits / all.samples,
+        100.0 * all.predicted / all.samples);
+
+    vector<int> sizes = vp_sizes();
+    for (size_t i = 0; i < sizes.size(); ++i)
+    {
+        char name[16];
+        if (sizes[i] == 0)
+            dr_snprintf(name, sizeof(name), "inf");
+        else
+            dr_snprintf(name, sizeof(name), "%d", sizes[i]);
+        name[sizeof(name) - 1] = '\0';
+
+        fprintf(stderr, "vp-window-%s=%.4f base=%.4f\n", name,
+            vp_totals[i].cycles > 0
+            ? (double) vp_totals[i].count / vp_totals[i].cycles : 0.0,
+            vp_base_totals[i].cycles > 0
+            ? (double) vp_base_totals[i].count / vp_base_totals[i].cycles
+            : 0.0);
+    }
+
+    sort(sorted.begin(), sorted.end(), more_values);
+    for (size_t i = 0; i < sorted.size() && (int) i < top; ++i)
+    {
+        const value_stats& stats = sorted[i].second;
+        fprintf(stderr, "  %s samples=%llu last-value=%.1f%% stride=%.1f%%\n",
+            block_location(sorted[i].first).c_str(),
+            (unsigned long long) stats.samples,
+            100.0 * stats.last_hits / stats.samples,
+            100.0 * stats.stride_hits / stats.samples);
+    }
+}
+
+void
+dynamic_report(int top)
+{
+    if (config.bpred != BPRED_PERFECT)
+        report_branches(top);
+    if (config.cache)
+        report_cache(top);
+    if (config.stride)
+        report_strides(top);
+    if (config.hazards)
+        report_hazards(top);
+    if (config.forwarding)
+        report_forwards(top);
+    if (config.values)
+        report_values(top);
+
+    for (size_t i = 0; i < config.windows.size(); ++i)
+    {
+        char name[16];
+        if (config.windows[i] == 0)
+            dr_snprintf(name, sizeof(name), "inf");
+        else
+            dr_snprintf(name, sizeof(name), "%d", config.windows[i]);
+        name[sizeof(name) - 1] = '\0';
+
+        fprintf(stderr, "ilp-window-%s=%.4f\n", name,
+            totals[i].cycles > 0
+            ? (double) totals[i].count / totals[i].cycles : 0.0);
+        if (config.mlp && totals[i].load_cycles > 0)
+            fprintf(stderr, "mlp-window-%s=%.4f peak=%u\n", name,
+                (double) totals[i].loads / totals[i].load_cycles,
+                totals[i].mlp_peak);
+    }
+}
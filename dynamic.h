@@ -0,0 +1,71 @@
+#ifndef ILP_DYNAMIC_H
+#define ILP_DYNAMIC_H
+
+#include "dr_api.h"
+#include "block.h"
+#include "bpred.h"
+#include "cache.h"
+#include "depgraph.h"
+
+#include <vector>
+
+/* Dynamic cross-block analysis.
+ *
+ * Inline code stores the effective address of every memory operand of a
+ * block into a per-thread slot array; a single clean call at the entry of
+ * the next block replays the finished block against per-thread state.
+ * Slot numbers are assigned statically, in collect_mem_refs() order, so the
+ * analysis and the instrumentation always agree on them.
+ */
+
+typedef struct {
+    opnd_t opnd;
+    bool   read;
+    bool   write;
+} mem_ref;
+
+void collect_mem_refs(instr_t* instr, std::vector<mem_ref>& refs);
+
+/* The general-purpose register whose value is captured after instr, or
+ * DR_REG_NULL.  Value slots are numbered in block order like address slots.
+ */
+reg_id_t value_reg(instr_t* instr);
+
+/* A mispredicted conditional branch at the end of a block keeps every later
+ * instruction in the limit study from issuing before the branch resolves.
+ * With the cache simulator on, the static load latency stands for an L1
+ * hit: a load that misses L1 pays the serving level's latency less L1's on
+ * top of it, so in all it waits about that level's latency.  With mlp set,
+ * finite windows also count how many loads issue in the same cycle.
+ * stride samples the addresses of every load for per-load strides, and
+ * when nothing else needs addresses only stores them in sampling bursts;
+ * hazards counts accesses that split a cache line and loads that alias an
+ * in-flight store 4 KiB away; forwarding charges loads that only partly
+ * overlap an in-flight store the latency of a failed store forward.
+ * values samples destination values for last-value and stride prediction,
+ * capturing them only for blocks that fall in a sampling burst, and
+ * replays those blocks with the predicted values available at once, next
+ * to a replay without prediction.
+ */
+typedef struct {
+    std::vector<int> windows;   /* limit-study window sizes, 0: unlimited */
+    bpred_kind       bpred;
+    bool             cache;
+    cache_config     levels[CACHE_LEVELS];
+    int              mem_latency;
+    bool             mlp;
+    bool             stride;
+    bool             hazards;
+    bool             forwarding;
+    bool             values;
+} dynamic_config;
+
+void dynamic_init(const dynamic_config& config);
+void dynamic_exit(void);
+void dynamic_thread_init(void* dc);
+void dynamic_thread_exit(void* dc);
+void dynamic_instrument(void* dc, instrlist_t* bb);
+void dynamic_block(void* dc, const block_info* info);
+void dynamic_report(int top);
+
+#endif /* ILP_DYNAMIC_H */
@@ -0,0 +1,146 @@
+#include "export.h"
+
+#include <string>
+
+using namespace std;
+
+/* "reg,mem" and "RAW,WAW" parts of an edge, joined by sep */
+static string
+kind_label(uint8_t kind, const char* sep)
+{
+    static const struct {
+        uint8_t     bit;
+        const char* name;
+    } names[] = {
+        { DEP_REG, "reg" }, { DEP_FLAG, "flag" }, { DEP_MEM, "mem" },
+        { DEP_RAW, "RAW" }, { DEP_WAW, "WAW" }, { DEP_WAR, "WAR" },
+    };
+    string parts[2];
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i)
+    {
+        if ((kind & names[i].bit) == 0)
+            continue;
+        string& part = parts[names[i].bit >= DEP_RAW];
+        if (!part.empty())
+            part += ",";
+        part += names[i].name;
+    }
+    if (parts[0].empty() || parts[1].empty())
+        return parts[0] + parts[1];
+    return parts[0] + sep + parts[1];
+}
+
+/* Quotes and backslashes are the only characters that need escaping in
+ * both a DOT label and a JSON string; disassembly has no control chars.
+ */
+static string
+escape(const string& text)
+{
+    string out;
+    for (string::const_iterator it = text.begin(); it != text.end(); ++it)
+    {
+        if (*it == '"' || *it == '\\')
+            out += '\\';
+        out += *it;
+    }
+    return out;
+}
+
+static string
+node_text(const block_info* info, size_t i)
+{
+    if (i < info->disasm.size())
+        return escape(info->disasm[i]);
+    return decode_opcode_name(info->graph[i].opcode);
+}
+
+static void
+dot_edges(file_t f, int b, int to, const vector<dep_edge>& edges,
+          const char* style)
+{
+    for (vector<dep_edge>::const_iterator it = edges.begin();
+         it != edges.end(); ++it)
+    {
+        dr_fprintf(f, "    b%d_%d -> b%d_%d [label=\"%s\"%s];\n",
+            b, it->from, b, to, kind_label(it->kind, "\\n").c_str(), style);
+    }
+}
+
+void
+export_dot(file_t f, const vector<const block_info*>& blocks)
+{
+    dr_fprintf(f, "digraph ilp {\n");
+    dr_fprintf(f, "  node [shape=box, fontname=monospace];\n");
+    for (size_t b = 0; b < blocks.size(); ++b)
+    {
+        const block_info* info = blocks[b];
+        dr_fprintf(f, "  subgraph cluster_%d {\n", (int) b);
+        dr_fprintf(f, "    label=\"%s ni=%d exec=%llu ilp=%.3f\";\n",
+            block_location(info->start_pc).c_str(), info->ni,
+            (unsigned long long) info->exec_count,
+            (double) info->ilp / 1000);
+        for (size_t i = 0; i < info->graph.size(); ++i)
+        {
+            const dep_node& node = info->graph[i];
+            dr_fprintf(f, "    b%d_%d [label=\"" PFX "\\n%s\\n"
+                "depth=%d lat=%d\"];\n", (int) b, (int) i, node.pc,
+                node_text(info, i).c_str(), node.start, node.latency);
+        }
+        for (size_t i = 0; i < info->graph.size(); ++i)
+        {
+            dot_edges(f, (int) b, (int) i, info->graph[i].preds, "");
+            dot_edges(f, (int) b, (int) i, info->graph[i].anti,
+                      ", style=dashed");
+        }
+        dr_fprintf(f, "  }\n");
+    }
+    dr_fprintf(f, "}\n");
+}
+
+static void
+json_edges(file_t f, int to, const vector<dep_edge>& edges, bool& first)
+{
+    for (vector<dep_edge>::const_iterator it = edges.begin();
+         it != edges.end(); ++it)
+    {
+        dr_fprintf(f, "%s\n        {\"from\": %d, \"to\": %d, "
+            "\"resources\": \"%s\", \"kinds\": \"%s\"}", first ? "" : ",",
+            it->from, to,
+            kind_label(it->kind & (DEP_RAW - 1), ",").c_str(),
+            kind_label(it->kind & ~(DEP_RAW - 1), ",").c_str());
+        first = false;
+    }
+}
+
+void
+export_json(file_t f, const vector<const block_info*>& blocks)
+{
+    dr_fprintf(f, "{\"blocks\": [");
+    for (size_t b = 0; b < blocks.size(); ++b)
+    {
+        const block_info* info = blocks[b];
+        dr_fprintf(f, "%s\n  {\"location\": \"%s\", \"pc\": \"" PFX "\", "
+            "\"ni\": %d, \"exec\": %llu, \"ilp\": %.3f, "
+            "\"dep_cycles\": %d,\n   \"nodes\": [", b == 0 ? "" : ",",
+            block_location(info->start_pc).c_str(), info->start_pc,
+            info->ni, (unsigned long long) info->exec_count,
+            (double) info->ilp / 1000, info->dep_cycles);
+        for (size_t i = 0; i < info->graph.size(); ++i)
+        {
+            const dep_node& node = info->graph[i];
+            dr_fprintf(f, "%s\n        {\"id\": %d, \"pc\": \"" PFX "\", "
+                "\"text\": \"%s\", \"latency\": %d, \"depth\": %d}",
+                i == 0 ? "" : ",", (int) i, node.pc,
+                node_text(info, i).c_str(), node.latency, node.start);
+        }
+        dr_fprintf(f, "],\n   \"edges\": [");
+        bool first = true;
+        for (size_t i = 0; i < info->graph.size(); ++i)
+        {
+            json_edges(f, (int) i, info->graph[i].preds, first);
+            json_edges(f, (int) i, info->graph[i].anti, first);
+        }
+        dr_fprintf(f, "]}");
+    }
+    dr_fprintf(f, "\n]}\n");
+}
@@ -0,0 +1,17 @@
+#ifndef ILP_EXPORT_H
+#define ILP_EXPORT_H
+
+#include "dr_api.h"
+#include "block.h"
+
+#include <vector>
+
+/* Dependency graph export.  Nodes carry the dataflow issue depth and
+ * latency; edges are labelled with the resources (reg, flag, mem) and
+ * kinds (RAW, WAW, WAR) they stand for.  WAR edges are drawn dashed in
+ * DOT: calculate_ilp records them but does not wait on them.
+ */
+void export_dot(file_t f, const std::vector<const block_info*>& blocks);
+void export_json(file_t f, const std::vector<const block_info*>& blocks);
+
+#endif /* ILP_EXPORT_H */
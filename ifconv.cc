@@ -0,0 +1,189 @@
+#include "ifconv.h"
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+using namespace std;
+
+/* General-purpose registers are linked by their full-size alias, flags
+ * and renamed registers by their own id.
+ */
+static int
+res_key(int res)
+{
+    if (res <= DR_REG_LAST_VALID_ENUM && reg_is_gpr((reg_id_t) res))
+        return reg_to_pointer_sized((reg_id_t) res);
+    return res;
+}
+
+static bool
+is_flag(int res)
+{
+    return res > DR_REG_LAST_VALID_ENUM && res < NUM_RESOURCES;
+}
+
+static bool
+is_select(int opcode)
+{
+    return (opcode >= OP_cmovo && opcode <= OP_cmovnle)
+        || (opcode >= OP_seto && opcode <= OP_setnle);
+}
+
+/* Condition code of a jcc, as an offset from OP_jo, or -1 */
+static int
+branch_condition(int opcode)
+{
+    if (opcode >= OP_jo && opcode <= OP_jnle)
+        return opcode - OP_jo;
+    if (opcode >= OP_jo_short && opcode <= OP_jnle_short)
+        return opcode - OP_jo_short;
+    return -1;
+}
+
+int
+ifconv_path(const dep_graph& graph, int first, int end,
+            bool selects_as_branches)
+{
+    map<int, int> ready;
+    int store_done = 0, length = 0;
+    for (int i = first; i < end; ++i)
+    {
+        const dep_node& node = graph[i];
+        bool branch = selects_as_branches && is_select(node.opcode);
+        int start = 0;
+        for (vector<uint16_t>::const_iterator it = node.src_res.begin();
+             it != node.src_res.end(); ++it)
+        {
+            if (branch && is_flag(*it))
+                continue;
+            map<int, int>::const_iterator r = ready.find(res_key(*it));
+            if (r != ready.end())
+                start = max(start, r->second);
+        }
+        if (!node.mem_srcs.empty() || !node.mem_dsts.empty())
+            start = max(start, store_done);
+
+        int done = start + node.latency;
+        for (vector<uint16_t>::const_iterator it = node.dst_res.begin();
+             it != node.dst_res.end(); ++it)
+            ready[res_key(*it)] = done;
+        if (!node.mem_dsts.empty())
+            store_done = done;
+        length = max(length, done);
+    }
+    return length;
+}
+
+int
+ifconv_branch_path(const block_info* head, const block_info* fall,
+                   int first)
+{
+    dep_graph path(head->graph);
+    path.insert(path.end(), fall->graph.begin() + first, fall->graph.end());
+    return ifconv_path(path, 0, (int) path.size(), false);
+}
+
+int
+ifconv_selects(const dep_graph& graph)
+{
+    int selects = 0;
+    for (dep_graph::const_iterator it = graph.begin(); it != graph.end(); ++it)
+    {
+        if (is_select(it->opcode))
+            selects++;
+    }
+    return selects;
+}
+
+/* Renames res if the guarded code wrote it, or allocates a new name */
+static uint16_t
+rename_res(map<int, int>& temps, int res, bool write)
+{
+    int key = res_key(res);
+    map<int, int>::const_iterator it = temps.find(key);
+    if (it != temps.end())
+        return (uint16_t) it->second;
+    if (!write)
+        return (uint16_t) res;
+    int temp = NUM_RESOURCES + (int) temps.size();
+    temps[key] = temp;
+    return (uint16_t) temp;
+}
+
+bool
+ifconv_hammock(const block_info* head, const block_info* fall,
+               ifconv_result* result)
+{
+    const dep_graph& a = head->graph;
+    const dep_graph& b = fall->graph;
+    if (head->cbr_pc == NULL || a.empty() || b.empty())
+        return false;
+    const dep_node& branch = a.back();
+    int cond = branch_condition(branch.opcode);
+    if (cond < 0)
+        return false;
+
+    int join = 0;
+    while (join < (int) b.size() && b[join].pc < head->cbr_target)
+        join++;
+    if (join == 0 || join > IFCONV_MAX_GUARDED || join == (int) b.size()
+        || b[join].pc != head->cbr_target)
+        return false;
+
+    dep_graph merged(a.begin(), a.end() - 1);
+    map<int, int> temps;    /* written by the guarded code -> new name */
+    for (int i = 0; i < join; ++i)
+    {
+        const dep_node& node = b[i];
+        if (node.mix == MIX_BRANCH || node.mix == MIX_STRING
+            || node.mix == MIX_X87 || !node.mem_dsts.empty())
+            return false;
+
+        dep_node copy = node;
+        for (vector<uint16_t>::iterator it = copy.src_res.begin();
+             it != copy.src_res.end(); ++it)
+            *it = rename_res(temps, *it, false);
+        for (vector<uint16_t>::iterator it = copy.dst_res.begin();
+             it != copy.dst_res.end(); ++it)
+        {
+            /* Only general-purpose registers can be selected by cmov */
+            int key = res_key(*it);
+            if (!is_flag(key) && (!reg_is_gpr((reg_id_t) key)
+                                  || key == DR_REG_XSP))
+                return false;
+            *it = rename_res(temps, *it, true);
+        }
+        merged.push_back(copy);
+    }
+
+    int cmovs = 0;
+    for (map<int, int>::const_iterator it = temps.begin();
+         it != temps.end(); ++it)
+    {
+        if (is_flag(it->first))
+            continue;
+        dep_node select = dep_node();
+        select.pc = head->cbr_pc;
+        /* The guarded value is taken when the branch is not: conditions
+         * come in pairs, each followed by its inverse
+         */
+        select.opcode = OP_cmovo + (cond ^ 1);
+        select.latency = CMOV_LATENCY;
+        select.mix = MIX_INT;
+        select.src_res = branch.src_res;
+        select.src_res.push_back((uint16_t) it->first);
+        select.src_res.push_back((uint16_t) it->second);
+        select.dst_res.push_back((uint16_t) it->first);
+        select.value_slot = VALUE_SLOT_NONE;
+        merged.push_back(select);
+        cmovs++;
+    }
+    merged.insert(merged.end(), b.begin() + join, b.end());
+
+    result->guarded = join;
+    result->cmovs = cmovs;
+    result->ni = (int) merged.size();
+    result->cycles = ifconv_path(merged, 0, (int) merged.size(), false);
+    return true;
+}
@@ -0,0 +1,52 @@
+#ifndef ILP_IFCONV_H
+#define ILP_IFCONV_H
+
+#include "dr_api.h"
+#include "block.h"
+
+/* If-conversion what-ifs.
+ *
+ * A hammock is a block closing with a forward conditional branch whose
+ * fall-through block runs a few straight-line instructions and then
+ * reaches the branch target.  Converting it drops the branch, executes the
+ * skipped instructions unconditionally into renamed registers, and joins
+ * every register they write with a cmov reading the branch's flags.  The
+ * reverse turns each cmov and setcc into a correctly predicted branch,
+ * dropping its flag inputs.
+ *
+ * Both sides are measured with the same dataflow critical path over the
+ * head and fall-through code laid end to end, so only the guard and the
+ * cmovs differ: registers and flags are linked through their last writer,
+ * memory accesses through the last store.  Mispredictions are not
+ * modelled here; -bpred gives the rate of the branch in question.
+ */
+
+/* Longest skipped sequence worth converting */
+#define IFCONV_MAX_GUARDED  8
+#define CMOV_LATENCY        1
+
+typedef struct {
+    int guarded;    /* fall-through instructions before the target */
+    int cmovs;      /* registers joined */
+    int ni;         /* instructions of the converted region */
+    int cycles;     /* its critical path */
+} ifconv_result;
+
+/* False unless head and fall form a convertible hammock */
+bool ifconv_hammock(const block_info* head, const block_info* fall,
+                    ifconv_result* result);
+
+/* Critical path of head, branch included, followed by the nodes of fall
+ * from first on: the branchy version of a hammock along one direction
+ */
+int ifconv_branch_path(const block_info* head, const block_info* fall,
+                       int first);
+
+/* Critical path of nodes [first, end) of graph */
+int ifconv_path(const dep_graph& graph, int first, int end,
+                bool selects_as_branches);
+
+/* cmov and setcc instructions in graph */
+int ifconv_selects(const dep_graph& graph);
+
+#endif /* ILP_IFCONV_H */
@@ -1,8 +1,24 @@
 #include "dr_api.h"
+#include "block.h"
+#include "bpred.h"
+#include "cache.h"
+#include "depgraph.h"
+#include "dynamic.h"
+#include "export.h"
+#include "ifconv.h"
+#include "loops.h"
+#include "sched.h"
+#include "simd.h"
+#include "uarch.h"
 
+#include <math.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
 #include <map>
 #include <set>
+#include <string>
 #include <utility>
 #include <vector>
 
@@ -12,6 +28,9 @@
 
 using namespace std;
 
+#define _MAX(x, y) (((x) > (y)) ? (x) : (y))
+#define _MIN(x, y) (((x) < (y)) ? (x) : (y))
+
 typedef struct {
     uint64_t total_ni;
     uint64_t sum_ilp;
@@ -20,39 +39,1301 @@ typedef struct {
 static ilp_stats stats;
 static ilp_stats offline_stats;
 
+/* Keyed by (tag, for_trace) so re-translations reuse the same record */
+typedef map< pair<void*, bool>, block_info* > block_map;
+
+static block_map blocks;
+static void* blocks_mutex;
+
+/* Self-looping blocks and traces, keyed like blocks */
+typedef map< pair<void*, bool>, loop_info* > loop_map;
+
+static loop_map loops;
+
+typedef struct {
+    string uarch;
+    string latency_file;
+    int    issue_width;
+    int    top_blocks;
+    bool   bounds;
+    bool   sched;
+    bool   fusion;
+    bool   loops;
+    bool   unroll;
+    bool   reductions;
+    bool   critical;
+    bool   profile;
+    bool   distribution;
+    bool   false_deps;
+    bool   regs;
+    bool   simd;
+    bool   mlp;
+    bool   mix;
+    bool   ifconv;
+    vector<string> graph_blocks;    /* "module+0xoff" or "top" */
+    string graph_file;
+    bool   graph_json;
+    dynamic_config dynamic;
+} ilp_options;
+
+static ilp_options options;
+
 #ifdef THREAD_SAFE_CLEAN_CALLS
 static void* stats_mutex;
 #endif
 
 static void event_exit(void);
+static void event_thread_init(void *drcontext);
+static void event_thread_exit(void *drcontext);
 static dr_emit_flags_t event_basic_block(void *drcontext, void *tag,
     instrlist_t *bb, bool for_trace, bool translating);
+static dr_emit_flags_t event_trace(void *drcontext, void *tag,
+    instrlist_t *trace, bool translating);
+static int false_critical_path(const block_info* info, int skip);
+
+static void
+split_list(const string& list, vector<string>& items)
+{
+    size_t pos = 0;
+    while (pos <= list.size())
+    {
+        size_t end = list.find(',', pos);
+        if (end == string::npos)
+            end = list.size();
+        if (end > pos)
+            items.push_back(list.substr(pos, end - pos));
+        pos = end + 1;
+    }
+}
+
+static void
+default_windows(void)
+{
+    static const int defaults[] = { 32, 64, 128, 256, 512, 0 };
+    options.dynamic.windows.assign(defaults, defaults + 6);
+}
+
+static void
+parse_windows(const string& list)
+{
+    vector<string> items;
+    split_list(list, items);
+    options.dynamic.windows.clear();
+    for (vector<string>::const_iterator it = items.begin();
+         it != items.end(); ++it)
+    {
+        if (*it == "inf")
+            options.dynamic.windows.push_back(0);
+        else if (atoi(it->c_str()) > 0)
+            options.dynamic.windows.push_back(atoi(it->c_str()));
+    }
+}
+
+/* Client options:
+ *     -uarch <name>          latency table to use (default: unit)
+ *     -latency_file <path>   per-opcode latency overrides
+ *     -issue_width <n>       instructions issued per cycle (default: 4)
+ *     -top <n>               blocks listed in per-block reports (default: 10)
+ *     -bounds                dependency- and port-bound cycles, with a -uarch
+ *                            that has a port model
+ *     -sched                 list-scheduled cycles and IPC at -issue_width
+ *     -fusion                also report ILP in fused-uop units
+ *     -critical              annotated disassembly of the top blocks with
+ *                            depths and the critical path marked
+ *     -profile               parallelism profile: instructions per depth
+ *     -distribution          histogram, percentiles and variance of block
+ *                            ILP weighted by dynamic instructions
+ *     -false_deps            ILP lost to partial-register, SSE merge and
+ *                            popcnt/lzcnt output dependencies
+ *     -regs                  register pressure of the ILP schedule and
+ *                            spills at 16 and 32 registers
+ *     -simd                  vector width use and operations per cycle
+ *     -mlp                   memory-level parallelism: independent loads
+ *                            per depth, per block and in the limit study
+ *     -mix                   instruction mix and per-class sub-graph ILP
+ *     -ifconv                if-conversion what-if, and cmov back to branches
+ *     -graph <sel,...>       export dependency graphs at exit of the blocks
+ *                            at these module+0xoff locations, "top" for
+ *                            the top blocks
+ *     -graph_format <fmt>    dot (default) or json
+ *     -graph_file <path>     output file (default: ilp-graph.dot/.json)
+ *     -loops                 recurrence-bound steady state of hot loops
+ *     -unroll                ILP of hot loops unrolled by 2/4/8, with and
+ *                            without accumulator splitting
+ *     -reductions            ILP of hot FP reduction loops with k partial
+ *                            accumulators
+ *     -limit_study           dynamic cross-block ILP for windows of
+ *                            32/64/128/256/512/inf instructions
+ *     -windows <n,n,...>     limit study with these window sizes ("inf")
+ *     -bpred <kind>          perfect (default), gshare or tage; mispredicts
+ *                            bound the limit-study windows (-limit_study
+ *                            windows unless -windows is given)
+ *     -cache                 simulate caches and charge loads their latency
+ *     -l1/-l2/-llc <s:w:l>   cache size:ways:latency, e.g. 32k:8:4
+ *     -mem_latency <n>       cycles for a load served by memory
+ *     -stride                sampled stride profile of hot loads
+ *     -mem_hazards           cache-line splits and 4K aliasing per access
+ *     -store_forward         failed store forwards, charged to the limit study
+ *                            (-limit_study windows unless -windows is given)
+ *     -value_predict         sampled value locality and value-prediction ILP
+ */
+static void
+parse_options(client_id_t id)
+{
+    options.uarch = "unit";
+    options.issue_width = 4;
+    options.top_blocks = 10;
+    options.dynamic.bpred = BPRED_PERFECT;
+    options.dynamic.cache = false;
+    cache_parse_config("32k:8:4", &options.dynamic.levels[0]);
+    cache_parse_config("256k:4:12", &options.dynamic.levels[1]);
+    cache_parse_config("8m:16:40", &options.dynamic.levels[2]);
+    options.dynamic.mem_latency = 200;
+
+    vector<string> args;
+    const char* opstr = dr_get_options(id);
+    while (opstr != NULL && *opstr != '\0')
+    {
+        while (*opstr == ' ' || *opstr == '\t')
+            ++opstr;
+        const char* end = opstr;
+        while (*end != '\0' && *end != ' ' && *end != '\t')
+            ++end;
+        if (end != opstr)
+            args.push_back(string(opstr, end - opstr));
+        opstr = end;
+    }
+
+    for (size_t i = 0; i < args.size(); ++i)
+    {
+        bool has_value = (i + 1 < args.size());
+        if (args[i] == "-uarch" && has_value)
+            options.uarch = args[++i];
+        else if (args[i] == "-latency_file" && has_value)
+            options.latency_file = args[++i];
+        else if (args[i] == "-issue_width" && has_value)
+            options.issue_width = _MAX(1, atoi(args[++i].c_str()));
+        else if (args[i] == "-top" && has_value)
+            options.top_blocks = _MAX(0, atoi(args[++i].c_str()));
+        else if (args[i] == "-bounds")
+            options.bounds = true;
+        else if (args[i] == "-sched")
+            options.sched = true;
+        else if (args[i] == "-fusion")
+            options.fusion = true;
+        else if (args[i] == "-critical")
+            options.critical = true;
+        else if (args[i] == "-profile")
+            options.profile = true;
+        else if (args[i] == "-distribution")
+            options.distribution = true;
+        else if (args[i] == "-false_deps")
+            options.false_deps = true;
+        else if (args[i] == "-regs")
+            options.regs = true;
+        else if (args[i] == "-simd")
+            options.simd = true;
+        else if (args[i] == "-mlp")
+            options.mlp = options.dynamic.mlp = true;
+        else if (args[i] == "-mix")
+            options.mix = true;
+        else if (args[i] == "-ifconv")
+            options.ifconv = true;
+        else if (args[i] == "-graph" && has_value)
+            split_list(args[++i], options.graph_blocks);
+        else if (args[i] == "-graph_format" && has_value
+                 && (args[i + 1] == "dot" || args[i + 1] == "json"))
+            options.graph_json = (args[++i] == "json");
+        else if (args[i] == "-graph_file" && has_value)
+            options.graph_file = args[++i];
+        else if (args[i] == "-loops")
+            options.loops = true;
+        else if (args[i] == "-unroll")
+            options.unroll = true;
+        else if (args[i] == "-reductions")
+            options.reductions = true;
+        else if (args[i] == "-limit_study")
+            default_windows();
+        else if (args[i] == "-windows" && has_value)
+            parse_windows(args[++i]);
+        else if (args[i] == "-bpred" && has_value
+                 && bpred_parse(args[i + 1].c_str(), &options.dynamic.bpred))
+            ++i;
+        else if (args[i] == "-cache")
+            options.dynamic.cache = true;
+        else if ((args[i] == "-l1" || args[i] == "-l2" || args[i] == "-llc")
+                 && has_value
+                 && cache_parse_config(args[i + 1].c_str(),
+                        &options.dynamic.levels[args[i] == "-l1" ? 0
+                                             : args[i] == "-l2" ? 1 : 2]))
+        {
+            options.dynamic.cache = true;
+            ++i;
+        }
+        else if (args[i] == "-stride")
+            options.dynamic.stride = true;
+        else if (args[i] == "-mem_hazards")
+            options.dynamic.hazards = true;
+        else if (args[i] == "-store_forward")
+            options.dynamic.forwarding = true;
+        else if (args[i] == "-value_predict")
+            options.dynamic.values = true;
+        else if (args[i] == "-mem_latency" && has_value)
+            options.dynamic.mem_latency = _MAX(0, atoi(args[++i].c_str()));
+        else
+        {
+            dr_fprintf(STDERR, "ilp: unknown option %s\n", args[i].c_str());
+            dr_abort();
+        }
+    }
+
+    /* Mispredicts and failed forwards only cost time in the limit study */
+    if ((options.dynamic.bpred != BPRED_PERFECT || options.dynamic.forwarding)
+        && options.dynamic.windows.empty())
+        default_windows();
+}
+
+static bool
+dynamic_enabled(void)
+{
+    return !options.dynamic.windows.empty()
+        || options.dynamic.bpred != BPRED_PERFECT || options.dynamic.cache
+        || options.dynamic.stride || options.dynamic.hazards
+        || options.dynamic.forwarding || options.dynamic.values;
+}
+
+static bool
+loops_enabled(void)
+{
+    return options.loops || options.unroll || options.reductions;
+}
 
 DR_EXPORT void 
 dr_init(client_id_t id)
 {
-    stats.total_ni = 0;
-    stats.sum_ilp = 0;
+    parse_options(id);
+
+    if (!uarch_select(options.uarch.c_str()))
+    {
+        dr_fprintf(STDERR, "ilp: unknown uarch %s, choose one of:",
+            options.uarch.c_str());
+        uarch_print_names(STDERR);
+        dr_abort();
+    }
+    if (!options.latency_file.empty()
+        && !uarch_load_overrides(options.latency_file.c_str()))
+        dr_abort();
+
+    stats.total_ni = 0;
+    stats.sum_ilp = 0;
+
+    offline_stats.total_ni = 0;
+    offline_stats.sum_ilp = 0;
+
+    blocks_mutex = dr_mutex_create();
+    
+#ifdef THREAD_SAFE_CLEAN_CALLS
+    stats_mutex = dr_mutex_create();
+#endif
+    
+    if (dynamic_enabled())
+    {
+        dynamic_init(options.dynamic);
+        dr_register_thread_init_event(event_thread_init);
+        dr_register_thread_exit_event(event_thread_exit);
+    }
+    
+    dr_register_bb_event(event_basic_block);
+    if (loops_enabled())
+        dr_register_trace_event(event_trace);
+    dr_register_exit_event(event_exit);
+}
+
+static void
+event_thread_init(void *drcontext)
+{
+    dynamic_thread_init(drcontext);
+}
+
+static void
+event_thread_exit(void *drcontext)
+{
+    dynamic_thread_exit(drcontext);
+}
+
+/* Compare, per block, the dependency bound with the port-pressure bound
+ * and report how much of the execution each of them limits.
+ */
+static void
+report_bounds(void)
+{
+    if (!uarch_has_ports())
+        return;
+
+    double dep_cycles = 0, port_cycles = 0, bound_cycles = 0;
+    uint64_t total_ni = 0, port_bound_ni = 0;
+
+    for (block_map::const_iterator it = blocks.begin();
+         it != blocks.end(); ++it)
+    {
+        const block_info* info = it->second;
+        double dep = (double) info->exec_count * info->dep_cycles;
+        double port = (double) info->exec_count * info->port_cycles / 1000;
+
+        dep_cycles += dep;
+        port_cycles += port;
+        bound_cycles += _MAX(dep, port);
+        total_ni += info->exec_count * info->ni;
+        if (port > dep)
+            port_bound_ni += info->exec_count * info->ni;
+    }
+
+    if (bound_cycles == 0 || total_ni == 0)
+        return;
+
+    fprintf(stderr, "dep-bound-cycles=%.0f\n", dep_cycles);
+    fprintf(stderr, "port-bound-cycles=%.0f\n", port_cycles);
+    fprintf(stderr, "ipc-bound=%.4f\n", (double) total_ni / bound_cycles);
+    fprintf(stderr, "port-bound-binding=%.2f%%\n",
+        100.0 * port_bound_ni / total_ni);
+}
+
+/* Blocks sorted by dynamic instruction count, hottest first */
+static bool
+hotter_block(const block_info* a, const block_info* b)
+{
+    return a->exec_count * a->ni > b->exec_count * b->ni;
+}
+
+static vector<block_info*>
+hot_blocks(void)
+{
+    vector<block_info*> hot;
+    for (block_map::const_iterator it = blocks.begin();
+         it != blocks.end(); ++it)
+    {
+        if (it->second->exec_count > 0)
+            hot.push_back(it->second);
+    }
+    sort(hot.begin(), hot.end(), hotter_block);
+    return hot;
+}
+
+string
+block_location(app_pc pc)
+{
+    char buf[256];
+    module_data_t* mod = dr_lookup_module(pc);
+    if (mod != NULL)
+    {
+        dr_snprintf(buf, sizeof(buf), "%s+0x%x",
+            dr_module_preferred_name(mod), (uint) (pc - mod->start));
+        dr_free_module_data(mod);
+    }
+    else
+        dr_snprintf(buf, sizeof(buf), PFX, pc);
+    buf[sizeof(buf) - 1] = '\0';
+    return string(buf);
+}
+
+static void
+report_schedule(void)
+{
+    double cycles = 0;
+    uint64_t total_ni = 0;
+    for (block_map::const_iterator it = blocks.begin();
+         it != blocks.end(); ++it)
+    {
+        cycles += (double) it->second->exec_count * it->second->sched_cycles;
+        total_ni += it->second->exec_count * it->second->ni;
+    }
+    if (cycles == 0)
+        return;
+
+    fprintf(stderr, "sched-issue-width=%d\n", options.issue_width);
+    fprintf(stderr, "sched-cycles=%.0f\n", cycles);
+    fprintf(stderr, "sched-ipc=%.4f\n", total_ni / cycles);
+
+    vector<block_info*> hot = hot_blocks();
+    for (size_t i = 0; i < hot.size() && (int) i < options.top_blocks; ++i)
+    {
+        const block_info* info = hot[i];
+        fprintf(stderr, "  %s ni=%d exec=%llu ilp=%.3f cycles=%d ipc=%.3f\n",
+            block_location(info->start_pc).c_str(), info->ni,
+            (unsigned long long) info->exec_count,
+            (double) info->ilp / 1000, info->sched_cycles,
+            info->sched_cycles > 0
+            ? (double) info->ni / info->sched_cycles : info->ni);
+    }
+}
+
+static void
+report_fusion(void)
+{
+    uint64_t total_ni = 0, fused_ni = 0, macro = 0, micro = 0;
+    double sum_fused_ilp = 0;
+    for (block_map::const_iterator it = blocks.begin();
+         it != blocks.end(); ++it)
+    {
+        const block_info* info = it->second;
+        total_ni += info->exec_count * info->ni;
+        fused_ni += info->exec_count * info->fused_ni;
+        macro += info->exec_count * info->macro_fused;
+        micro += info->exec_count * info->micro_fused;
+        sum_fused_ilp +=
+            (double) info->exec_count * info->fused_ni * info->fused_ilp;
+    }
+
+    fprintf(stderr, "ilp-fused=%.4f\n", sum_fused_ilp / fused_ni / 1000);
+    fprintf(stderr, "fused-uops=%.2f%% of instrs, macro-fused=%.2f%%, "
+        "micro-fused=%.2f%%\n", 100.0 * fused_ni / total_ni,
+        100.0 * macro / total_ni, 100.0 * micro / total_ni);
+
+    vector<block_info*> hot = hot_blocks();
+    for (size_t i = 0; i < hot.size() && (int) i < options.top_blocks; ++i)
+    {
+        const block_info* info = hot[i];
+        fprintf(stderr, "  %s ni=%d uops=%d macro=%d micro=%d "
+            "ilp=%.3f ilp-fused=%.3f\n",
+            block_location(info->start_pc).c_str(), info->ni,
+            info->fused_ni, info->macro_fused, info->micro_fused,
+            (double) info->ilp / 1000, (double) info->fused_ilp / 1000);
+    }
+}
+
+/* Slack of every node against the block's critical path: zero-slack nodes
+ * lie on some longest chain.  `chain' gets one such chain, walked back
+ * from the node that finishes last through producers that finish exactly
+ * when their consumer issues.
+ */
+static void
+critical_path(const block_info* info, vector<int>& slack, vector<bool>& chain)
+{
+    const dep_graph& graph = info->graph;
+    int n = (int) graph.size();
+    vector<int> latest(n, info->dep_cycles);
+    for (int i = n - 1; i >= 0; --i)
+    {
+        latest[i] = _MIN(latest[i], info->dep_cycles) - graph[i].latency;
+        for (vector<dep_edge>::const_iterator it = graph[i].preds.begin();
+             it != graph[i].preds.end(); ++it)
+            latest[it->from] = _MIN(latest[it->from], latest[i]);
+    }
+
+    slack.resize(n);
+    chain.assign(n, false);
+    int last = -1;
+    for (int i = 0; i < n; ++i)
+    {
+        slack[i] = latest[i] - graph[i].start;
+        if (graph[i].start + graph[i].latency == info->dep_cycles)
+            last = i;
+    }
+    while (last >= 0)
+    {
+        chain[last] = true;
+        int next = -1;
+        for (vector<dep_edge>::const_iterator it = graph[last].preds.begin();
+             it != graph[last].preds.end(); ++it)
+        {
+            const dep_node& pred = graph[it->from];
+            if (pred.start + pred.latency == graph[last].start)
+                next = _MAX(next, it->from);
+        }
+        last = next;
+    }
+}
+
+/* Hot blocks disassembled with each instruction's dataflow issue cycle
+ * and slack; '*' marks the longest chain, '+' other zero-slack nodes.
+ */
+static void
+report_critical(void)
+{
+    uint64_t total_ni = 0;
+    for (block_map::const_iterator it = blocks.begin();
+         it != blocks.end(); ++it)
+        total_ni += it->second->exec_count * it->second->ni;
+
+    vector<block_info*> hot = hot_blocks();
+    for (size_t i = 0; i < hot.size() && (int) i < options.top_blocks; ++i)
+    {
+        const block_info* info = hot[i];
+        fprintf(stderr, "critical %s ni=%d exec=%llu share=%.2f%% ilp=%.3f "
+            "cycles=%d\n", block_location(info->start_pc).c_str(), info->ni,
+            (unsigned long long) info->exec_count,
+            100.0 * info->exec_count * info->ni / total_ni,
+            (double) info->ilp / 1000, info->dep_cycles);
+
+        vector<int> slack;
+        vector<bool> chain;
+        critical_path(info, slack, chain);
+        for (size_t j = 0; j < info->graph.size(); ++j)
+        {
+            const dep_node& node = info->graph[j];
+            fprintf(stderr, "  %c depth=%-4d lat=%-3d slack=%-4d " PFX "  %s\n",
+                chain[j] ? '*' : (slack[j] == 0 ? '+' : ' '), node.start,
+                node.latency, slack[j], node.pc,
+                j < info->disasm.size() ? info->disasm[j].c_str() : "");
+        }
+    }
+}
+
+/* Depths past the last bucket are folded into it */
+#define PROFILE_DEPTHS 64
+#define PROFILE_WIDTHS 16
+
+/* Parallelism profile: how many instructions issue at each dataflow
+ * depth, and how many cycles run at each width, execution-weighted over
+ * all blocks and per hot block.
+ */
+static void
+report_profile(void)
+{
+    double depths[PROFILE_DEPTHS] = { 0 };
+    double widths[PROFILE_WIDTHS + 1] = { 0 };
+    double total_ni = 0, total_cycles = 0;
+    for (block_map::const_iterator it = blocks.begin();
+         it != blocks.end(); ++it)
+    {
+        const block_info* info = it->second;
+        const vector<uint16_t>& profile = info->profile;
+        for (size_t d = 0; d < profile.size(); ++d)
+        {
+            depths[_MIN(d, PROFILE_DEPTHS - 1)] +=
+                (double) info->exec_count * profile[d];
+            widths[_MIN(profile[d], PROFILE_WIDTHS)] += info->exec_count;
+        }
+        total_ni += (double) info->exec_count * info->ni;
+        total_cycles += (double) info->exec_count * profile.size();
+    }
+
+    fprintf(stderr, "profile-depth:");
+    for (int d = 0; d < PROFILE_DEPTHS; ++d)
+    {
+        if (depths[d] > 0)
+            fprintf(stderr, " %d%s=%.2f%%", d,
+                d == PROFILE_DEPTHS - 1 ? "+" : "", 100 * depths[d] / total_ni);
+    }
+    fprintf(stderr, "\nprofile-width:");
+    for (int w = 0; w <= PROFILE_WIDTHS; ++w)
+    {
+        if (widths[w] > 0)
+            fprintf(stderr, " %d%s=%.2f%%", w,
+                w == PROFILE_WIDTHS ? "+" : "", 100 * widths[w] / total_cycles);
+    }
+    fprintf(stderr, "\n");
+
+    vector<block_info*> hot = hot_blocks();
+    for (size_t i = 0; i < hot.size() && (int) i < options.top_blocks; ++i)
+    {
+        const block_info* info = hot[i];
+        fprintf(stderr, "  %s ni=%d ilp=%.3f profile=",
+            block_location(info->start_pc).c_str(), info->ni,
+            (double) info->ilp / 1000);
+        for (size_t d = 0; d < info->profile.size(); ++d)
+            fprintf(stderr, d == 0 ? "%d" : ",%d", info->profile[d]);
+        fprintf(stderr, "\n");
+    }
+}
+
+/* Log-scale ILP buckets, four per doubling, from 1/8 up to 64 */
+#define ILP_BUCKETS_PER_OCTAVE 4
+#define ILP_BUCKET_MIN         -3
+#define ILP_BUCKETS            (9 * ILP_BUCKETS_PER_OCTAVE + 1)
+
+static bool
+lower_ilp(const block_info* a, const block_info* b)
+{
+    return a->ilp < b->ilp;
+}
+
+/* Distribution of per-block ILP, every block weighted by the dynamic
+ * instructions it accounts for.  Percentiles come from the sorted blocks,
+ * not from the buckets.
+ */
+static void
+report_distribution(void)
+{
+    vector<block_info*> sorted = hot_blocks();
+    sort(sorted.begin(), sorted.end(), lower_ilp);
+
+    double total_ni = 0, sum = 0, sum_sq = 0;
+    double buckets[ILP_BUCKETS] = { 0 };
+    for (vector<block_info*>::const_iterator it = sorted.begin();
+         it != sorted.end(); ++it)
+    {
+        double weight = (double) (*it)->exec_count * (*it)->ni;
+        double ilp = (double) (*it)->ilp / 1000;
+        total_ni += weight;
+        sum += weight * ilp;
+        sum_sq += weight * ilp * ilp;
+
+        int b = (ilp > 0) ? (int) floor(log2(ilp) * ILP_BUCKETS_PER_OCTAVE)
+            - ILP_BUCKET_MIN * ILP_BUCKETS_PER_OCTAVE : 0;
+        buckets[_MAX(0, _MIN(b, ILP_BUCKETS - 1))] += weight;
+    }
+    if (total_ni == 0)
+        return;
+
+    double mean = sum / total_ni;
+    fprintf(stderr, "ilp-mean=%.4f\n", mean);
+    fprintf(stderr, "ilp-variance=%.4f\n", sum_sq / total_ni - mean * mean);
+
+    static const int percentiles[] = { 10, 50, 90, 99 };
+    const size_t num_percentiles = sizeof(percentiles) / sizeof(percentiles[0]);
+    double seen = 0;
+    size_t next = 0;
+    for (vector<block_info*>::const_iterator it = sorted.begin();
+         it != sorted.end() && next < num_percentiles; ++it)
+    {
+        seen += (double) (*it)->exec_count * (*it)->ni;
+        while (next < num_percentiles
+               && seen >= total_ni * percentiles[next] / 100)
+        {
+            fprintf(stderr, "ilp-p%d=%.4f\n", percentiles[next],
+                (double) (*it)->ilp / 1000);
+            ++next;
+        }
+    }
+
+    for (int b = 0; b < ILP_BUCKETS; ++b)
+    {
+        if (buckets[b] == 0)
+            continue;
+        double low = exp2((double) b / ILP_BUCKETS_PER_OCTAVE
+                          + ILP_BUCKET_MIN);
+        double high = exp2((double) (b + 1) / ILP_BUCKETS_PER_OCTAVE
+                           + ILP_BUCKET_MIN);
+        if (b == ILP_BUCKETS - 1)
+            fprintf(stderr, "  ilp %7.3f+        %6.2f%%\n",
+                low, 100 * buckets[b] / total_ni);
+        else
+            fprintf(stderr, "  ilp %7.3f..%-7.3f %6.2f%%\n",
+                b == 0 ? 0 : low, high, 100 * buckets[b] / total_ni);
+    }
+}
+
+static const char*
+false_dep_name(uint8_t reason)
+{
+    switch (reason)
+    {
+    case FALSE_PARTIAL: return "partial";
+    case FALSE_MERGE:   return "merge";
+    case FALSE_OUTPUT:  return "output";
+    }
+    return "?";
+}
+
+/* ILP with the false dependencies the hardware enforces, against the
+ * graph's ILP without them, and per dependency what breaking only that
+ * one would gain (xor-zeroing, movzx, vcvtsi2sd with a fresh source).
+ */
+static void
+report_false_deps(void)
+{
+    double sum_ilp = 0, sum_false_ilp = 0, total_ni = 0;
+    uint64_t affected_ni = 0;
+    for (block_map::const_iterator it = blocks.begin();
+         it != blocks.end(); ++it)
+    {
+        const block_info* info = it->second;
+        double weight = (double) info->exec_count * info->ni;
+        total_ni += weight;
+        sum_ilp += weight * info->ilp;
+        sum_false_ilp += weight * info->false_ilp;
+        if (info->false_ilp != info->ilp)
+            affected_ni += info->exec_count * info->ni;
+    }
+    if (total_ni == 0)
+        return;
+
+    fprintf(stderr, "ilp-false-deps=%.4f\n", sum_false_ilp / total_ni / 1000);
+    fprintf(stderr, "ilp-no-false-deps=%.4f\n", sum_ilp / total_ni / 1000);
+    fprintf(stderr, "false-deps-affected=%.2f%% of instrs\n",
+        100.0 * affected_ni / total_ni);
+
+    vector<block_info*> hot = hot_blocks();
+    int shown = 0;
+    for (size_t i = 0; i < hot.size() && shown < options.top_blocks; ++i)
+    {
+        const block_info* info = hot[i];
+        if (info->false_ilp == info->ilp)
+            continue;
+        ++shown;
+        fprintf(stderr, "  %s ni=%d exec=%llu ilp %.3f -> %.3f "
+            "if all broken\n", block_location(info->start_pc).c_str(),
+            info->ni, (unsigned long long) info->exec_count,
+            (double) info->false_ilp / 1000, (double) info->ilp / 1000);
+        for (size_t d = 0; d < info->false_deps.size(); ++d)
+        {
+            const false_dep& dep = info->false_deps[d];
+            int nc = false_critical_path(info, (int) d);
+            fprintf(stderr, "    " PFX " %s %s: ilp %.3f -> %.3f if broken\n",
+                info->graph[dep.to].pc, get_register_name(dep.reg),
+                false_dep_name(dep.reason), (double) info->false_ilp / 1000,
+                nc > 0 ? (double) info->ni / nc : info->ni);
+        }
+    }
+}
+
+/* Values beyond the register file, per class, each costing a spill
+ * store and a reload.
+ */
+static int
+spills(const block_info* info, int num_regs)
+{
+    return _MAX(0, info->live_gprs - num_regs)
+        + _MAX(0, info->live_vecs - num_regs);
+}
+
+static void
+report_regs(void)
+{
+    static const int files[] = { 16, 32 };
+    double total_ni = 0, sum_gprs = 0, sum_vecs = 0;
+    double spill_ops[2] = { 0, 0 };
+    for (block_map::const_iterator it = blocks.begin();
+         it != blocks.end(); ++it)
+    {
+        const block_info* info = it->second;
+        double weight = (double) info->exec_count * info->ni;
+        total_ni += weight;
+        sum_gprs += weight * info->live_gprs;
+        sum_vecs += weight * info->live_vecs;
+        for (int f = 0; f < 2; ++f)
+            spill_ops[f] += 2.0 * info->exec_count * spills(info, files[f]);
+    }
+    if (total_ni == 0)
+        return;
+
+    fprintf(stderr, "live-gprs=%.2f\n", sum_gprs / total_ni);
+    fprintf(stderr, "live-vecs=%.2f\n", sum_vecs / total_ni);
+    for (int f = 0; f < 2; ++f)
+        fprintf(stderr, "spill-ops-%d=%.2f%% of instrs\n", files[f],
+            100 * spill_ops[f] / total_ni);
+
+    vector<block_info*> hot = hot_blocks();
+    for (size_t i = 0; i < hot.size() && (int) i < options.top_blocks; ++i)
+    {
+        const block_info* info = hot[i];
+        fprintf(stderr, "  %s ni=%d ilp=%.3f live-gprs=%d live-vecs=%d "
+            "spills-16=%d spills-32=%d\n",
+            block_location(info->start_pc).c_str(), info->ni,
+            (double) info->ilp / 1000, info->live_gprs, info->live_vecs,
+            spills(info, 16), spills(info, 32));
+    }
+}
+
+/* ILP times DLP: elements operated on per cycle of the dataflow critical
+ * path.  Utilisation compares the lanes of SSE/AVX instructions, scalar
+ * forms included, with what they would cover at SIMD_MAX_BITS.
+ */
+static void
+report_simd(void)
+{
+    double total_ni = 0, lanes = 0, cycles = 0;
+    double simd_ni = 0, simd_lanes = 0, simd_max_lanes = 0;
+    for (block_map::const_iterator it = blocks.begin();
+         it != blocks.end(); ++it)
+    {
+        const block_info* info = it->second;
+        double execs = (double) info->exec_count;
+        total_ni += execs * info->ni;
+        lanes += execs * info->lanes;
+        cycles += execs * info->dep_cycles;
+        simd_ni += execs * info->simd_ni;
+        simd_lanes += execs * info->simd_lanes;
+        simd_max_lanes += execs * info->simd_max_lanes;
+    }
+    if (total_ni == 0 || cycles == 0)
+        return;
+
+    fprintf(stderr, "simd-instrs=%.2f%%\n", 100 * simd_ni / total_ni);
+    fprintf(stderr, "lanes-per-instr=%.4f\n", lanes / total_ni);
+    fprintf(stderr, "ops-per-cycle=%.4f\n", lanes / cycles);
+    if (simd_max_lanes > 0)
+        fprintf(stderr, "vector-utilisation=%.2f%% of %d bits\n",
+            100 * simd_lanes / simd_max_lanes, SIMD_MAX_BITS);
+
+    vector<block_info*> hot = hot_blocks();
+    for (size_t i = 0; i < hot.size() && (int) i < options.top_blocks; ++i)
+    {
+        const block_info* info = hot[i];
+        fprintf(stderr, "  %s ni=%d ilp=%.3f simd=%d lanes/instr=%.2f "
+            "ops/cycle=%.3f util=%.0f%%\n",
+            block_location(info->start_pc).c_str(), info->ni,
+            (double) info->ilp / 1000, info->simd_ni,
+            (double) info->lanes / info->ni,
+            info->dep_cycles > 0
+                ? (double) info->lanes / info->dep_cycles : info->lanes,
+            info->simd_max_lanes > 0
+                ? 100.0 * info->simd_lanes / info->simd_max_lanes : 0);
+    }
+}
+
+/* Static MLP: loads per dataflow depth that has any, within a block */
+static void
+report_mlp(void)
+{
+    double loads = 0, depths = 0, sum_peak = 0;
+    int peak = 0;
+    for (block_map::const_iterator it = blocks.begin();
+         it != blocks.end(); ++it)
+    {
+        const block_info* info = it->second;
+        if (info->exec_count == 0)
+            continue;
+        loads += (double) info->exec_count * info->loads;
+        depths += (double) info->exec_count * info->load_depths;
+        sum_peak += (double) info->exec_count * info->loads * info->mlp_peak;
+        peak = _MAX(peak, info->mlp_peak);
+    }
+    if (loads == 0)
+        return;
+
+    fprintf(stderr, "mlp=%.4f\n", loads / depths);
+    fprintf(stderr, "mlp-peak=%d mlp-peak-avg=%.4f\n", peak, sum_peak / loads);
+
+    vector<block_info*> hot = hot_blocks();
+    for (size_t i = 0; i < hot.size() && (int) i < options.top_blocks; ++i)
+    {
+        const block_info* info = hot[i];
+        fprintf(stderr, "  %s ni=%d ilp=%.3f loads=%d mlp=%.3f peak=%d\n",
+            block_location(info->start_pc).c_str(), info->ni,
+            (double) info->ilp / 1000, info->loads,
+            info->load_depths > 0
+                ? (double) info->loads / info->load_depths : 0.0,
+            info->mlp_peak);
+    }
+}
+
+/* Dynamic share of every class and the ILP of its sub-graph alone,
+ * weighted by the class's own dynamic instructions.
+ */
+static void
+report_mix(void)
+{
+    double total_ni = 0;
+    double mix_ni[MIX_CLASSES] = { 0 }, mix_cycles[MIX_CLASSES] = { 0 };
+    for (block_map::const_iterator it = blocks.begin();
+         it != blocks.end(); ++it)
+    {
+        const block_info* info = it->second;
+        double execs = (double) info->exec_count;
+        total_ni += execs * info->ni;
+        for (int c = 0; c < MIX_CLASSES; ++c)
+        {
+            mix_ni[c] += execs * info->mix_ni[c];
+            mix_cycles[c] += execs * info->mix_cycles[c];
+        }
+    }
+    if (total_ni == 0)
+        return;
+
+    for (int c = 0; c < MIX_CLASSES; ++c)
+    {
+        if (mix_ni[c] == 0)
+            continue;
+        fprintf(stderr, "mix-%s=%.2f%% ilp-%s=%.4f\n", mix_name(c),
+            100 * mix_ni[c] / total_ni, mix_name(c),
+            mix_cycles[c] > 0 ? mix_ni[c] / mix_cycles[c] : mix_ni[c]);
+    }
+
+    vector<block_info*> hot = hot_blocks();
+    for (size_t i = 0; i < hot.size() && (int) i < options.top_blocks; ++i)
+    {
+        const block_info* info = hot[i];
+        fprintf(stderr, "  %s ni=%d ilp=%.3f",
+            block_location(info->start_pc).c_str(), info->ni,
+            (double) info->ilp / 1000);
+        for (int c = 0; c < MIX_CLASSES; ++c)
+        {
+            if (info->mix_ni[c] > 0)
+                fprintf(stderr, " %s=%d/%.2f", mix_name(c), info->mix_ni[c],
+                    info->mix_cycles[c] > 0
+                    ? (double) info->mix_ni[c] / info->mix_cycles[c]
+                    : info->mix_ni[c]);
+        }
+        fprintf(stderr, "\n");
+    }
+}
+
+/* A convertible hammock with the expected cost per execution of its
+ * branch left in place: the fall-through block runs when the branch is
+ * not taken, only its part from the target on when it is.
+ */
+typedef struct {
+    const block_info* head;
+    double            taken;    /* share of executions */
+    double            ni;
+    double            cycles;
+    ifconv_result     result;
+} hammock;
+
+/* Executions of the fall-through code over both of its copies: once a
+ * trace starts there, the plain block only counts side entries.
+ */
+static const block_info*
+fall_through(const block_info* head, uint64_t* execs)
+{
+    const block_info* fall = NULL;
+    *execs = 0;
+    for (int trace = 0; trace < 2; ++trace)
+    {
+        block_map::const_iterator it =
+            blocks.find(make_pair((void*) head->cbr_fall, trace == 1));
+        if (it == blocks.end())
+            continue;
+        *execs += it->second->exec_count;
+        if (fall == NULL)
+            fall = it->second;
+    }
+    return fall;
+}
+
+static void
+report_ifconv(void)
+{
+    /* Executions of each branch, over every fragment it closes */
+    map<app_pc, uint64_t> branch_execs;
+    for (block_map::const_iterator it = blocks.begin();
+         it != blocks.end(); ++it)
+    {
+        if (it->second->cbr_pc != NULL)
+            branch_execs[it->second->cbr_pc] += it->second->exec_count;
+    }
+
+    double ni = 0, cycles = 0, conv_ni = 0, conv_cycles = 0;
+    vector<hammock> found;
+    vector<block_info*> hot = hot_blocks();
+    for (size_t i = 0; i < hot.size(); ++i)
+    {
+        const block_info* head = hot[i];
+        if (head->cbr_pc == NULL || head->cbr_target <= head->cbr_fall)
+            continue;
+        uint64_t fall_execs;
+        const block_info* fall = fall_through(head, &fall_execs);
+        hammock h;
+        if (fall == NULL || !ifconv_hammock(head, fall, &h.result))
+            continue;
+
+        int n = (int) fall->graph.size(), join = h.result.guarded;
+        double p_fall = _MIN(1.0,
+            (double) fall_execs / branch_execs[head->cbr_pc]);
+        h.head = head;
+        h.taken = 1 - p_fall;
+        h.ni = head->ni + p_fall * n + h.taken * (n - join);
+        h.cycles = p_fall * ifconv_branch_path(head, fall, 0)
+            + h.taken * ifconv_branch_path(head, fall, join);
+
+        ni += head->exec_count * h.ni;
+        cycles += head->exec_count * h.cycles;
+        conv_ni += (double) head->exec_count * h.result.ni;
+        conv_cycles += (double) head->exec_count * h.result.cycles;
+        found.push_back(h);
+    }
+    if (found.empty() || cycles == 0 || conv_cycles == 0)
+        return;
+
+    fprintf(stderr, "ifconv-hammocks=%d\n", (int) found.size());
+    fprintf(stderr, "ilp-branchy=%.4f\n", ni / cycles);
+    fprintf(stderr, "ilp-ifconv=%.4f\n", conv_ni / conv_cycles);
+    fprintf(stderr, "ifconv-cycles=%.2f%% of branchy\n",
+        100.0 * conv_cycles / cycles);
+
+    for (size_t i = 0; i < found.size() && (int) i < options.top_blocks; ++i)
+    {
+        const hammock& h = found[i];
+        fprintf(stderr, "  %s exec=%llu guarded=%d cmovs=%d taken=%.1f%% "
+            "cycles %.2f -> %d\n", block_location(h.head->cbr_pc).c_str(),
+            (unsigned long long) h.head->exec_count, h.result.guarded,
+            h.result.cmovs, 100.0 * h.taken, h.cycles, h.result.cycles);
+    }
+}
+
+/* The reverse: cmov and setcc as correctly predicted branches */
+static void
+report_selects(void)
+{
+    double total_ni = 0, cycles = 0, branch_cycles = 0;
+    int selecting = 0;
+    vector<block_info*> hot = hot_blocks();
+    for (size_t i = 0; i < hot.size(); ++i)
+    {
+        const block_info* info = hot[i];
+        if (ifconv_selects(info->graph) == 0)
+            continue;
+        int n = (int) info->graph.size();
+        total_ni += (double) info->exec_count * info->ni;
+        cycles += (double) info->exec_count
+            * ifconv_path(info->graph, 0, n, false);
+        branch_cycles += (double) info->exec_count
+            * ifconv_path(info->graph, 0, n, true);
+        selecting++;
+    }
+    if (selecting == 0 || cycles == 0 || branch_cycles == 0)
+        return;
+
+    fprintf(stderr, "select-blocks=%d\n", selecting);
+    fprintf(stderr, "ilp-selects=%.4f\n", total_ni / cycles);
+    fprintf(stderr, "ilp-as-branches=%.4f\n", total_ni / branch_cycles);
+
+    int shown = 0;
+    for (size_t i = 0; i < hot.size() && shown < options.top_blocks; ++i)
+    {
+        const block_info* info = hot[i];
+        int selects = ifconv_selects(info->graph);
+        if (selects == 0)
+            continue;
+        ++shown;
+        int n = (int) info->graph.size();
+        int nc = ifconv_path(info->graph, 0, n, false);
+        int bc = ifconv_path(info->graph, 0, n, true);
+        fprintf(stderr, "  %s ni=%d exec=%llu selects=%d ilp %.3f -> %.3f\n",
+            block_location(info->start_pc).c_str(), info->ni,
+            (unsigned long long) info->exec_count, selects,
+            nc > 0 ? (double) info->ni / nc : info->ni,
+            bc > 0 ? (double) info->ni / bc : info->ni);
+    }
+}
+
+/* Blocks picked by -graph, hottest first, each at most once */
+static void
+export_graphs(void)
+{
+    vector<block_info*> hot = hot_blocks();
+    vector<const block_info*> selected;
+    for (size_t i = 0; i < hot.size(); ++i)
+    {
+        bool pick = false;
+        string where = block_location(hot[i]->start_pc);
+        for (vector<string>::const_iterator it = options.graph_blocks.begin();
+             it != options.graph_blocks.end() && !pick; ++it)
+        {
+            pick = (*it == where)
+                || (*it == "top" && (int) i < options.top_blocks);
+        }
+        if (pick)
+            selected.push_back(hot[i]);
+    }
+
+    string path = options.graph_file;
+    if (path.empty())
+        path = options.graph_json ? "ilp-graph.json" : "ilp-graph.dot";
+    file_t f = dr_open_file(path.c_str(), DR_FILE_WRITE_OVERWRITE);
+    if (f == INVALID_FILE)
+    {
+        dr_fprintf(STDERR, "ilp: cannot open graph file %s\n", path.c_str());
+        return;
+    }
+    if (options.graph_json)
+        export_json(f, selected);
+    else
+        export_dot(f, selected);
+    dr_close_file(f);
+    fprintf(stderr, "graph-blocks=%u in %s\n", (uint) selected.size(),
+        path.c_str());
+}
+
+/* Loops sorted by dynamic instruction count, hottest first */
+static bool
+hotter_loop(const loop_info* a, const loop_info* b)
+{
+    return a->head->exec_count * a->ni > b->head->exec_count * b->ni;
+}
+
+static vector<loop_info*>
+hot_loops(void)
+{
+    vector<loop_info*> hot;
+    for (loop_map::const_iterator it = loops.begin();
+         it != loops.end(); ++it)
+    {
+        if (it->second->head->exec_count > 0)
+            hot.push_back(it->second);
+    }
+    sort(hot.begin(), hot.end(), hotter_loop);
+    return hot;
+}
+
+/* Steady state of each loop: an iteration starts every II cycles, where
+ * II is the larger of the recurrence and resource bounds.
+ */
+static void
+report_loops(void)
+{
+    vector<loop_info*> hot = hot_loops();
+    uint64_t total_ni = 0;
+    double cycles = 0;
+    for (vector<loop_info*>::const_iterator it = hot.begin();
+         it != hot.end(); ++it)
+    {
+        uint64_t iters = (*it)->head->exec_count;
+        total_ni += iters * (*it)->ni;
+        cycles += iters * _MAX((*it)->rec_mii, (*it)->res_mii);
+    }
+
+    fprintf(stderr, "loops=%u\n", (uint) hot.size());
+    if (cycles > 0)
+        fprintf(stderr, "ilp-loops-steady=%.4f\n", total_ni / cycles);
+    for (size_t i = 0; i < hot.size() && (int) i < options.top_blocks; ++i)
+    {
+        const loop_info* loop = hot[i];
+        double ii = _MAX(loop->rec_mii, loop->res_mii);
+        fprintf(stderr, "  %s%s ni=%d iters=%llu recurrences=%d "
+            "rec-mii=%.2f res-mii=%.2f iter-per-cycle=%.3f ilp=%.3f "
+            "ilp-steady=%.3f\n",
+            block_location(loop->head_pc).c_str(),
+            loop->trace ? " trace" : "", loop->ni,
+            (unsigned long long) loop->head->exec_count, loop->recurrences,
+            loop->rec_mii, loop->res_mii, ii > 0 ? 1 / ii : 0,
+            (double) loop->ilp / 1000, ii > 0 ? loop->ni / ii : 0);
+    }
+}
+
+static void
+report_unroll(void)
+{
+    vector<loop_info*> hot = hot_loops();
+    fprintf(stderr, "unroll-factors=");
+    for (int f = 0; f < UNROLL_FACTORS; ++f)
+        fprintf(stderr, f == 0 ? "%d" : ",%d", unroll_factors[f]);
+    fprintf(stderr, "\n");
+
+    for (size_t i = 0; i < hot.size() && (int) i < options.top_blocks; ++i)
+    {
+        const loop_info* loop = hot[i];
+        fprintf(stderr, "  %s%s ni=%d iters=%llu accumulators=%d ilp=%.3f",
+            block_location(loop->head_pc).c_str(),
+            loop->trace ? " trace" : "", loop->ni,
+            (unsigned long long) loop->head->exec_count,
+            loop->accumulators, (double) loop->ilp / 1000);
+        for (int f = 0; f < UNROLL_FACTORS; ++f)
+            fprintf(stderr, " x%d=%.3f", unroll_factors[f],
+                (double) loop->unroll_ilp[f] / 1000);
+        for (int f = 0; f < UNROLL_FACTORS; ++f)
+            fprintf(stderr, " x%d-split=%.3f", unroll_factors[f],
+                (double) loop->split_ilp[f] / 1000);
+        fprintf(stderr, "\n");
+    }
+}
+
+/* Steady-state ILP of a loop whose FP reduction chains are spread over k
+ * accumulators each.
+ */
+static double
+reduction_ilp(const loop_info* loop, int k)
+{
+    double ii = _MAX(loop->rec_mii_other, loop->res_mii);
+    ii = _MAX(ii, (double) loop->fp_chain_latency / k);
+    return (ii > 0) ? loop->ni / ii : loop->ni;
+}
+
+static void
+report_reductions(void)
+{
+    static const int accumulators[] = { 1, 2, 4, 8 };
+    const int num_k = sizeof(accumulators) / sizeof(accumulators[0]);
 
-    offline_stats.total_ni = 0;
-    offline_stats.sum_ilp = 0;
-    
-#ifdef THREAD_SAFE_CLEAN_CALLS
-    stats_mutex = dr_mutex_create();
-#endif
-    
-    dr_register_bb_event(event_basic_block);
-    dr_register_exit_event(event_exit);
+    vector<loop_info*> hot = hot_loops();
+    uint64_t loop_ni = 0, bound_ni = 0;
+    for (vector<loop_info*>::const_iterator it = hot.begin();
+         it != hot.end(); ++it)
+    {
+        const loop_info* loop = *it;
+        uint64_t ni = loop->head->exec_count * loop->ni;
+        loop_ni += ni;
+        if (loop->fp_reductions > 0 && loop->fp_chain_latency
+            > _MAX(loop->rec_mii_other, loop->res_mii))
+            bound_ni += ni;
+    }
+    if (loop_ni > 0)
+        fprintf(stderr, "reduction-bound=%.2f%% of loop instrs\n",
+            100.0 * bound_ni / loop_ni);
+
+    int shown = 0;
+    for (size_t i = 0; i < hot.size() && shown < options.top_blocks; ++i)
+    {
+        const loop_info* loop = hot[i];
+        if (loop->fp_reductions == 0)
+            continue;
+        ++shown;
+        fprintf(stderr, "  %s%s ni=%d iters=%llu chains=%d %s lat=%d",
+            block_location(loop->head_pc).c_str(),
+            loop->trace ? " trace" : "", loop->ni,
+            (unsigned long long) loop->head->exec_count,
+            loop->fp_reductions, decode_opcode_name(loop->fp_opcode),
+            loop->fp_chain_latency);
+        for (int k = 0; k < num_k; ++k)
+            fprintf(stderr, " k%d=%.3f", accumulators[k],
+                reduction_ilp(loop, accumulators[k]));
+        fprintf(stderr, "\n");
+    }
 }
 
 static void 
 event_exit(void)
 {
+    fprintf(stderr, "uarch=%s\n", uarch_name());
+    /* Older versions counted to the issue of the last instruction */
+    fprintf(stderr, "critical-path=completion\n");
+
     fprintf(stderr, "ilp=%.4f\n",
         (double) stats.sum_ilp / stats.total_ni / 1000);
 
     fprintf(stderr, "ilp-offline=%.4f\n",
         (double) offline_stats.sum_ilp / offline_stats.total_ni / 1000);
+
+    if (options.bounds)
+        report_bounds();
+    if (options.sched)
+        report_schedule();
+    if (options.fusion)
+        report_fusion();
+    if (options.critical)
+        report_critical();
+    if (options.profile)
+        report_profile();
+    if (options.distribution)
+        report_distribution();
+    if (options.false_deps)
+        report_false_deps();
+    if (options.regs)
+        report_regs();
+    if (options.simd)
+        report_simd();
+    if (options.mlp)
+        report_mlp();
+    if (options.mix)
+        report_mix();
+    if (options.ifconv)
+    {
+        report_ifconv();
+        report_selects();
+    }
+    if (!options.graph_blocks.empty())
+        export_graphs();
+    if (options.loops)
+        report_loops();
+    if (options.unroll)
+        report_unroll();
+    if (options.reductions)
+        report_reductions();
+    if (dynamic_enabled())
+    {
+        dynamic_report(options.top_blocks);
+        dynamic_exit();
+    }
+
+    for (loop_map::iterator it = loops.begin(); it != loops.end(); ++it)
+        delete it->second;
+    loops.clear();
+    for (block_map::iterator it = blocks.begin(); it != blocks.end(); ++it)
+        delete it->second;
+    blocks.clear();
+    dr_mutex_destroy(blocks_mutex);
         
 #ifdef THREAD_SAFE_CLEAN_CALLS
     dr_mutex_destroy(stats_mutex);
@@ -72,6 +1353,90 @@ get_full_size_reg(reg_id_t reg)
     return reg;
 }
 
+/* The register a GPR name is part of: AL, AX, EAX and RAX share RAX, and
+ * R8B..R8D share R8, on x64.
+ */
+inline reg_id_t
+full_reg(reg_id_t reg)
+{
+    return reg_is_gpr(reg) ? reg_to_pointer_sized(reg) : reg;
+}
+
+/* A GPR write that keeps the rest of its full register.  32-bit writes
+ * zero-extend on x64, so only 8- and 16-bit ones merge.
+ */
+inline bool
+partial_write(reg_id_t reg)
+{
+    return reg_is_gpr(reg) && opnd_size_in_bytes(reg_get_size(reg)) < 4;
+}
+
+/* x87 register stack.  ST(i) is relative to the top of stack, which
+ * loads push and stores pop, so the same name holds different values
+ * along a block.  Operands are renamed to the slot they occupied at block
+ * entry: slot[] maps stack positions to those names, and fxch only swaps
+ * two entries.  fninit and frstor restart the names from an empty stack.
+ * The names only hold within the block; its exit stack is kept so the
+ * dynamic engine can carry them across blocks.
+ */
+typedef struct {
+    int top;
+    int slot[8];
+} x87_stack;
+
+inline void
+x87_reset(x87_stack& stack)
+{
+    stack.top = 0;
+    for (int i = 0; i < 8; ++i)
+        stack.slot[i] = i;
+}
+
+inline reg_id_t
+x87_slot(const x87_stack& stack, reg_id_t reg)
+{
+    if (reg < DR_REG_ST0 || reg > DR_REG_ST7)
+        return reg;
+    return DR_REG_ST0 + stack.slot[(stack.top + reg - DR_REG_ST0) & 7];
+}
+
+/* Stack positions pushed (> 0) or popped (< 0) */
+inline int
+x87_stack_effect(int opcode)
+{
+    switch (opcode)
+    {
+    case OP_fld: case OP_fild: case OP_fbld: case OP_fld1: case OP_fldz:
+    case OP_fldl2t: case OP_fldl2e: case OP_fldpi: case OP_fldlg2:
+    case OP_fldln2: case OP_fptan: case OP_fxtract: case OP_fsincos:
+    case OP_fdecstp:
+        return 1;
+    case OP_fstp: case OP_fistp: case OP_fisttp: case OP_fbstp:
+    case OP_faddp: case OP_fsubp: case OP_fsubrp: case OP_fmulp:
+    case OP_fdivp: case OP_fdivrp: case OP_fcomp: case OP_ficomp:
+    case OP_fucomp: case OP_fcomip: case OP_fucomip: case OP_ffreep:
+    case OP_fyl2x: case OP_fyl2xp1: case OP_fpatan: case OP_fincstp:
+        return -1;
+    case OP_fcompp: case OP_fucompp:
+        return -2;
+    }
+    return 0;
+}
+
+inline void
+x87_exchange(x87_stack& stack, instr_t* fxch)
+{
+    reg_id_t other = DR_REG_ST1;
+    for (int i = 0; i < instr_num_srcs(fxch); ++i)
+    {
+        opnd_t opnd = instr_get_src(fxch, i);
+        if (opnd_is_reg(opnd) && opnd_get_reg(opnd) != DR_REG_ST0)
+            other = opnd_get_reg(opnd);
+    }
+    int a = stack.top, b = (stack.top + other - DR_REG_ST0) & 7;
+    swap(stack.slot[a], stack.slot[b]);
+}
+
 inline void
 insert_unique(vector<opnd_t>& list, const opnd_t& opnd)
 {
@@ -106,6 +1471,8 @@ get_read_eflags(uint eflags, set<int>& read_eflags)
     if (eflags & EFLAGS_READ_DF) read_eflags.insert(EFLAGS_DF);
     if (eflags & EFLAGS_READ_OF) read_eflags.insert(EFLAGS_OF);
     if (eflags & EFLAGS_READ_PF) read_eflags.insert(EFLAGS_PF);
+    if (eflags & EFLAGS_READ_SF) read_eflags.insert(EFLAGS_SF);
+    if (eflags & EFLAGS_READ_ZF) read_eflags.insert(EFLAGS_ZF);
 }
 
 inline void
@@ -116,31 +1483,358 @@ get_write_eflags(uint eflags, set<int>& write_eflags)
     if (eflags & EFLAGS_WRITE_DF) write_eflags.insert(EFLAGS_DF);
     if (eflags & EFLAGS_WRITE_OF) write_eflags.insert(EFLAGS_OF);
     if (eflags & EFLAGS_WRITE_PF) write_eflags.insert(EFLAGS_PF);
+    if (eflags & EFLAGS_WRITE_SF) write_eflags.insert(EFLAGS_SF);
+    if (eflags & EFLAGS_WRITE_ZF) write_eflags.insert(EFLAGS_ZF);
 }
 
-#define _MAX(x, y) (((x) > (y)) ? (x) : (y))
+inline void
+add_edge(vector<dep_edge>& edges, int from, uint8_t kind)
+{
+    if (from < 0)
+        return;
+    for (vector<dep_edge>::iterator it = edges.begin();
+         it != edges.end(); ++it)
+    {
+        if (it->from == from)
+        {
+            it->kind |= kind;
+            return;
+        }
+    }
+    dep_edge edge = { from, kind };
+    edges.push_back(edge);
+}
+
+inline void
+add_dep(dep_node& node, int from, uint8_t kind)
+{
+    add_edge(node.preds, from, kind);
+}
+
+/* WAR edges from every reader since the resource was last written */
+inline void
+add_anti(dep_node& node, int idx, vector<int>& readers, uint8_t kind)
+{
+    for (vector<int>::const_iterator it = readers.begin();
+         it != readers.end(); ++it)
+    {
+        if (*it != idx)
+            add_edge(node.anti, *it, kind | DEP_WAR);
+    }
+    readers.clear();
+}
+
+inline int
+find_writer(const map<reg_id_t, int>& writers, reg_id_t reg)
+{
+    map<reg_id_t, int>::const_iterator it = writers.find(reg);
+    return (it == writers.end()) ? -1 : it->second;
+}
+
+inline void
+insert_addr_regs(set<reg_id_t>& regs, const opnd_t& opnd)
+{
+    if (opnd_get_base(opnd) != DR_REG_NULL)
+        regs.insert(opnd_get_base(opnd));
+    if (opnd_get_index(opnd) != DR_REG_NULL)
+        regs.insert(opnd_get_index(opnd));
+}
+
+/* Scalar SSE ops that only write the low lane of their destination */
+static bool
+merges_xmm_dst(int opcode)
+{
+    switch (opcode)
+    {
+    case OP_cvtsi2sd: case OP_cvtsi2ss: case OP_cvtss2sd: case OP_cvtsd2ss:
+    case OP_sqrtsd: case OP_sqrtss: case OP_rcpss: case OP_rsqrtss:
+    case OP_roundsd: case OP_roundss:
+        return true;
+    }
+    return false;
+}
+
+/* Destinations whose only tie to the previous writer is a false
+ * dependency: the ordering is recorded in false_deps instead of as a WAW
+ * edge, so it stays out of the baseline timing.
+ */
+static bool
+false_output_dep(int opcode, reg_id_t reg)
+{
+    return (reg_is_xmm(reg) && merges_xmm_dst(opcode))
+        || opcode == OP_popcnt || opcode == OP_lzcnt || opcode == OP_tzcnt;
+}
+
+inline void
+add_false_dep(block_info* info, int from, int to, reg_id_t reg,
+              uint8_t reason)
+{
+    if (from < 0)
+        return;
+    false_dep dep = { from, to, reg, reason };
+    info->false_deps.push_back(dep);
+}
+
+/* Dataflow critical path with the block's false dependencies honoured,
+ * all but the one at index skip.
+ */
+static int
+false_critical_path(const block_info* info, int skip)
+{
+    const dep_graph& graph = info->graph;
+    int n = (int) graph.size();
+    vector< vector<int> > extra(n);
+    for (size_t i = 0; i < info->false_deps.size(); ++i)
+    {
+        if ((int) i != skip)
+            extra[info->false_deps[i].to].push_back(info->false_deps[i].from);
+    }
+
+    int nc = 0;
+    vector<int> start(n);
+    for (int i = 0; i < n; ++i)
+    {
+        int ic = 0;
+        for (vector<dep_edge>::const_iterator it = graph[i].preds.begin();
+             it != graph[i].preds.end(); ++it)
+            ic = _MAX(ic, start[it->from] + graph[it->from].latency);
+        for (vector<int>::const_iterator it = extra[i].begin();
+             it != extra[i].end(); ++it)
+            ic = _MAX(ic, start[*it] + graph[*it].latency);
+        start[i] = ic;
+        nc = _MAX(nc, ic + graph[i].latency);
+    }
+    return nc;
+}
+
+/* Critical path of each class's sub-graph: only edges between two
+ * instructions of the same class are followed.
+ */
+static void
+mix_critical_paths(block_info* info)
+{
+    const dep_graph& graph = info->graph;
+    vector<int> start(graph.size());
+    for (size_t i = 0; i < graph.size(); ++i)
+    {
+        const dep_node& node = graph[i];
+        int ic = 0;
+        for (vector<dep_edge>::const_iterator it = node.preds.begin();
+             it != node.preds.end(); ++it)
+        {
+            const dep_node& pred = graph[it->from];
+            if (pred.mix == node.mix)
+                ic = _MAX(ic, start[it->from] + pred.latency);
+        }
+        start[i] = ic;
+        info->mix_cycles[node.mix] = _MAX(info->mix_cycles[node.mix],
+                                          ic + node.latency);
+    }
+}
+
+typedef struct {
+    bool vec;
+    int  begin;
+    int  end;
+} live_range;
+
+/* GPRs other than the stack pointer, and vector registers */
+inline bool
+allocatable(uint16_t res)
+{
+    if (res >= RES_FLAG(1))
+        return false;
+    reg_id_t reg = full_reg((reg_id_t) res);
+    return reg != DR_REG_XSP
+        && (reg_is_gpr(reg) || reg_is_xmm(reg) || reg_is_ymm(reg));
+}
+
+/* Largest number of values of one register class live at once */
+static int
+max_live(const vector<live_range>& ranges, bool vec)
+{
+    vector< pair<int, int> > events;
+    for (vector<live_range>::const_iterator it = ranges.begin();
+         it != ranges.end(); ++it)
+    {
+        if (it->vec != vec)
+            continue;
+        events.push_back(make_pair(it->begin, 1));
+        events.push_back(make_pair(_MAX(it->end, it->begin + 1), -1));
+    }
+    /* A range ending at t frees its register for one starting at t */
+    sort(events.begin(), events.end());
+    int live = 0, peak = 0;
+    for (vector< pair<int, int> >::const_iterator it = events.begin();
+         it != events.end(); ++it)
+    {
+        live += it->second;
+        peak = _MAX(peak, live);
+    }
+    return peak;
+}
+
+/* Register pressure of the dataflow schedule: a value lives from the
+ * cycle its producer completes to the issue of its last reader.  Values
+ * live on entry start at cycle 0, the last value of every register is
+ * live out to the end of the block.
+ */
+static void
+register_pressure(block_info* info)
+{
+    const dep_graph& graph = info->graph;
+    vector<live_range> ranges;
+    map<reg_id_t, int> current;
+
+    for (dep_graph::const_iterator node = graph.begin();
+         node != graph.end(); ++node)
+    {
+        for (vector<uint16_t>::const_iterator it = node->src_res.begin();
+             it != node->src_res.end(); ++it)
+        {
+            if (!allocatable(*it))
+                continue;
+            reg_id_t reg = full_reg((reg_id_t) *it);
+            map<reg_id_t, int>::iterator value = current.find(reg);
+            if (value == current.end())
+            {
+                live_range in = { !reg_is_gpr(reg), 0, node->start };
+                value = current.insert(make_pair(reg,
+                    (int) ranges.size())).first;
+                ranges.push_back(in);
+            }
+            live_range& range = ranges[value->second];
+            range.end = _MAX(range.end, node->start);
+        }
+        for (vector<uint16_t>::const_iterator it = node->dst_res.begin();
+             it != node->dst_res.end(); ++it)
+        {
+            if (!allocatable(*it))
+                continue;
+            reg_id_t reg = full_reg((reg_id_t) *it);
+            int done = node->start + node->latency;
+            live_range out = { !reg_is_gpr(reg), done, done };
+            current[reg] = (int) ranges.size();
+            ranges.push_back(out);
+        }
+    }
+    for (map<reg_id_t, int>::const_iterator it = current.begin();
+         it != current.end(); ++it)
+        ranges[it->second].end = _MAX(ranges[it->second].end,
+                                      info->dep_cycles);
+
+    info->live_gprs = max_live(ranges, false);
+    info->live_vecs = max_live(ranges, true);
+}
+
+/* Critical path with every macro-fused jcc issuing and completing
+ * together with its flag producer.
+ */
+static int
+fused_critical_path(const dep_graph& graph)
+{
+    int n = (int) graph.size();
+    int nc = 0;
+    vector<int> start(n), finish(n);
+    for (int i = 0; i < n; ++i)
+    {
+        const dep_node& node = graph[i];
+        int ic = node.fused ? start[i - 1] : 0;
+        for (vector<dep_edge>::const_iterator it = node.preds.begin();
+             it != node.preds.end(); ++it)
+        {
+            if (!node.fused || it->from != i - 1)
+                ic = _MAX(ic, finish[it->from]);
+        }
+        start[i] = ic;
+        finish[i] = node.fused ? _MAX(finish[i - 1], ic) : ic + node.latency;
+        nc = _MAX(nc, finish[i]);
+    }
+    return nc;
+}
 
 static void
-calculate_ilp(instrlist_t* bb, int32_t& ni, int32_t& ilp)
+calculate_ilp(instrlist_t* bb, block_info* info)
 {
+    dep_graph& graph = info->graph;
+    int32_t& ni = info->ni;
+    int32_t& ilp = info->ilp;
     ni = 0;
     int nc = 0;
-    map<reg_id_t, int> reg_nc;
-    //vector< pair<opnd_t, int> >  mem_nc;
-    int mem_nc = 0;
-    map<int, int> eflags_nc;
+    int sum_latency = 0;
+    port_pressure pressure;
+    map<reg_id_t, int> reg_writer;
+    int mem_writer = -1;
+    map<reg_id_t, vector<int> > reg_readers;
+    vector<int> mem_readers;
+    map<reg_id_t, pair<int, reg_id_t> > alias_writer;   /* writer, as */
+    map<int, int> eflags_writer;
+    instr_t* prev = NULL;
+    int mem_slot = 0;
+    int value_slot = 0;
+    x87_stack x87;
+    x87_reset(x87);
 
     /* Look for the following types of dependencies:
      *     reg -> reg
-     *     reg -> base_reg in base+disp memory
-     *     mem -> mem, in opnd_same_mem() we trust
+     *     reg -> base/index reg in base+disp memory
+     *     mem -> mem, through a single memory resource
      *     EFLAGS
+     * Every edge points at the last writer of the resource; writing a
+     * register or memory also waits for its previous writer (WAW).
      */
 
     for (instr_t* instr = instrlist_first(bb);
          instr != NULL; instr = instr_get_next(instr))
     {
-        int ic = 0;
+        /* Traces already carry our block-entry instrumentation */
+        if (!instr_ok_to_mangle(instr))
+            continue;
+
+        int idx = (int) graph.size();
+        graph.push_back(dep_node());
+        dep_node& node = graph.back();
+        node.pc = instr_get_app_pc(instr);
+        node.opcode = instr_get_opcode(instr);
+        node.latency = instr_latency(instr);
+        node.fused = uarch_macro_fuses(prev, instr)
+            && !graph[idx - 1].fused;
+        uarch_instr_uops(instr, node.uops);
+
+        /* fxch is resolved at rename: no latency, no port, no operands */
+        bool fxch = (node.opcode == OP_fxch);
+        if (fxch)
+        {
+            node.latency = 0;
+            node.uops.clear();
+        }
+        node.mix = (uint8_t) mix_classify(instr);
+        info->mix_ni[node.mix]++;
+
+        simd_class simd;
+        simd_classify(instr, &simd);
+        info->lanes += simd.lanes;
+        if (simd.width > 0 && simd.elem > 0)
+        {
+            info->simd_ni++;
+            info->simd_lanes += simd.lanes;
+            info->simd_max_lanes += SIMD_MAX_BITS / simd.elem;
+        }
+        if (options.critical || !options.graph_blocks.empty())
+        {
+            char buf[128];
+            instr_disassemble_to_buffer(dr_get_current_drcontext(), instr,
+                                        buf, sizeof(buf));
+            buf[sizeof(buf) - 1] = '\0';
+            info->disasm.push_back(buf);
+        }
+        if (node.fused)
+            info->macro_fused++;
+        if (uarch_micro_fuses(instr))
+            info->micro_fused++;
+        for (vector<uint16_t>::const_iterator it = node.uops.begin();
+             it != node.uops.end(); ++it)
+            pressure[*it]++;
         
         /* Process source operands */
         set<reg_id_t>    src_regs;
@@ -152,10 +1846,13 @@ calculate_ilp(instrlist_t* bb, int32_t& ni, int32_t& ilp)
         {
             opnd_t opnd = instr_get_src(instr, i);
             if (opnd_is_reg(opnd))
-                src_regs.insert(opnd_get_reg(opnd));
+            {
+                if (!fxch)
+                    src_regs.insert(x87_slot(x87, opnd_get_reg(opnd)));
+            }
             else if (opnd_is_base_disp(opnd))
             {
-                src_regs.insert(opnd_get_base(opnd));
+                insert_addr_regs(src_regs, opnd);
                 insert_unique(src_mems, opnd);
             }
             else if (opnd_is_abs_addr(opnd) || opnd_is_pc(opnd))
@@ -164,101 +1861,236 @@ calculate_ilp(instrlist_t* bb, int32_t& ni, int32_t& ilp)
             }
         }
 
-        int dst_cnt_1 = instr_num_dsts(instr);
-        for (int i = 0; i < dst_cnt_1; ++i)
+        /* Process destination operands */
+        set<reg_id_t>    dst_regs;
+        vector<opnd_t>   dst_mems;
+        set<int>         write_eflags;
+
+        /* Pushes name their results after the push, pops before the pop */
+        int stack_effect = x87_stack_effect(node.opcode);
+        if (stack_effect > 0)
+            x87.top = (x87.top - stack_effect) & 7;
+
+        int dst_cnt = instr_num_dsts(instr);
+        for (int i = 0; i < dst_cnt; ++i)
         {
             opnd_t opnd = instr_get_dst(instr, i);
             if (opnd_is_reg(opnd))
-                src_regs.insert(opnd_get_reg(opnd));
+            {
+                if (!fxch)
+                    dst_regs.insert(x87_slot(x87, opnd_get_reg(opnd)));
+            }
             else if (opnd_is_base_disp(opnd))
             {
-                src_regs.insert(opnd_get_base(opnd));
-                insert_unique(src_mems, opnd);
+                insert_addr_regs(src_regs, opnd);
+                insert_unique(dst_mems, opnd);
             }
-            else if (opnd_is_abs_addr(opnd) || opnd_is_pc(opnd))
+            else if (opnd_is_abs_addr(opnd))
             {
-                insert_unique(src_mems, opnd);
+                insert_unique(dst_mems, opnd);
             }
         }
+        if (stack_effect < 0)
+            x87.top = (x87.top - stack_effect) & 7;
+        if (fxch)
+            x87_exchange(x87, instr);
+        /* Empties or reloads the whole stack, with its top at 0 */
+        if (node.opcode == OP_fninit || node.opcode == OP_frstor)
+        {
+            x87_reset(x87);
+            info->x87_init = true;
+        }
         
         uint eflags = instr_get_eflags(instr);
         get_read_eflags(eflags, read_eflags);
+        get_write_eflags(eflags, write_eflags);
+
+        /* Resources and address slots for the dynamic engine */
+        node.src_res.assign(src_regs.begin(), src_regs.end());
+        node.dst_res.assign(dst_regs.begin(), dst_regs.end());
+        for (set<int>::const_iterator it = read_eflags.begin();
+             it != read_eflags.end(); ++it)
+            node.src_res.push_back(RES_FLAG(*it));
+        for (set<int>::const_iterator it = write_eflags.begin();
+             it != write_eflags.end(); ++it)
+            node.dst_res.push_back(RES_FLAG(*it));
+
+        vector<mem_ref> refs;
+        collect_mem_refs(instr, refs);
+        for (vector<mem_ref>::const_iterator it = refs.begin();
+             it != refs.end(); ++it)
+        {
+            uint8_t slot = (mem_slot < MAX_MEM_SLOTS) ? mem_slot++
+                                                      : MEM_SLOT_UNKNOWN;
+            if (slot != MEM_SLOT_UNKNOWN)
+                info->slot_sizes.push_back((uint8_t) _MIN(255,
+                    opnd_size_in_bytes(opnd_get_size(it->opnd))));
+            if (it->read)
+                node.mem_srcs.push_back(slot);
+            if (it->write)
+                node.mem_dsts.push_back(slot);
+        }
+
+        reg_id_t value = value_reg(instr);
+        node.value_slot = VALUE_SLOT_NONE;
+        node.value_res = value;
+        if (value != DR_REG_NULL && value_slot < MAX_VALUE_SLOTS)
+            node.value_slot = (uint8_t) value_slot++;
         
         for (set<reg_id_t>::const_iterator it = src_regs.begin();
              it != src_regs.end(); ++it)
         {
-            ic = _MAX(ic, reg_nc[*it]);
+            add_dep(node, find_writer(reg_writer, *it), DEP_REG | DEP_RAW);
         }
         
-        for (vector<opnd_t>::const_iterator it = src_mems.begin();
-             it != src_mems.end(); ++it)
+        for (set<reg_id_t>::const_iterator it = dst_regs.begin();
+             it != dst_regs.end(); ++it)
         {
-            //pair<opnd_t, int>* pRecord = find_same_mem(mem_nc, *it);
-            //if (pRecord)
-            //    ic = _MAX(ic, pRecord->second);    
-            ic = _MAX(ic, mem_nc);    
+            if (src_regs.count(*it) == 0
+                && !false_output_dep(node.opcode, *it))
+                add_dep(node, find_writer(reg_writer, *it), DEP_REG | DEP_WAW);
         }
         
+        if (!src_mems.empty())
+            add_dep(node, mem_writer, DEP_MEM | DEP_RAW);
+        if (!dst_mems.empty())
+            add_dep(node, mem_writer, DEP_MEM | DEP_WAW);
+
+        /* Anti-dependencies are only recorded for the graph export */
+        for (set<reg_id_t>::const_iterator it = dst_regs.begin();
+             it != dst_regs.end(); ++it)
+            add_anti(node, idx, reg_readers[*it], DEP_REG);
+        if (!dst_mems.empty())
+            add_anti(node, idx, mem_readers, DEP_MEM);
+        for (set<reg_id_t>::const_iterator it = src_regs.begin();
+             it != src_regs.end(); ++it)
+            reg_readers[*it].push_back(idx);
+        if (!src_mems.empty())
+            mem_readers.push_back(idx);
+        
         for (set<int>::const_iterator it = read_eflags.begin();
              it != read_eflags.end(); ++it)
         {
-            ic = _MAX(ic, eflags_nc[*it]);
+            map<int, int>::const_iterator w = eflags_writer.find(*it);
+            if (w != eflags_writer.end())
+                add_dep(node, w->second, DEP_FLAG | DEP_RAW);
         }
         
-        nc = _MAX(ic, nc);
-        
-        /* Process destination operands */
-        set<reg_id_t>    dst_regs;
-        vector<opnd_t>   dst_mems;
-        set<int>         write_eflags;
-        
-        int dst_cnt = instr_num_dsts(instr);
-        for (int i = 0; i < dst_cnt; ++i)
+        /* False dependencies, kept out of the timing above */
+        for (set<reg_id_t>::const_iterator it = src_regs.begin();
+             it != src_regs.end(); ++it)
         {
-            opnd_t opnd = instr_get_dst(instr, i);
-            if (opnd_is_reg(opnd))
-                dst_regs.insert(opnd_get_reg(opnd));
-            else if (opnd_is_base_disp(opnd) || opnd_is_abs_addr(opnd))
-            {
-                insert_unique(dst_mems, opnd);
-            }
+            map<reg_id_t, pair<int, reg_id_t> >::const_iterator w =
+                alias_writer.find(full_reg(*it));
+            if (w != alias_writer.end() && w->second.second != *it
+                && partial_write(w->second.second)
+                && opnd_size_in_bytes(reg_get_size(*it))
+                   > opnd_size_in_bytes(reg_get_size(w->second.second)))
+                add_false_dep(info, w->second.first, idx, *it, FALSE_PARTIAL);
         }
-        
-        get_write_eflags(eflags, write_eflags);
-        
         for (set<reg_id_t>::const_iterator it = dst_regs.begin();
              it != dst_regs.end(); ++it)
         {
-            reg_nc[*it] = ic + 1;
+            reg_id_t full = full_reg(*it);
+            map<reg_id_t, pair<int, reg_id_t> >::const_iterator w =
+                alias_writer.find(full);
+            if (partial_write(*it) && w != alias_writer.end()
+                && w->second.second != *it)
+                add_false_dep(info, w->second.first, idx, full, FALSE_PARTIAL);
+            if (src_regs.count(*it) != 0
+                || !false_output_dep(node.opcode, *it))
+                continue;
+            add_false_dep(info, find_writer(reg_writer, *it), idx, *it,
+                          reg_is_xmm(*it) ? FALSE_MERGE : FALSE_OUTPUT);
+        }
+
+        /* Issue as soon as the last producer's result is ready */
+        node.start = 0;
+        for (vector<dep_edge>::const_iterator it = node.preds.begin();
+             it != node.preds.end(); ++it)
+        {
+            const dep_node& pred = graph[it->from];
+            node.start = _MAX(node.start, pred.start + pred.latency);
         }
         
-        for (vector<opnd_t>::const_iterator it = dst_mems.begin();
-             it != dst_mems.end(); ++it)
+        /* The critical path ends when the last result is ready */
+        nc = _MAX(node.start + node.latency, nc);
+        sum_latency += node.latency;
+        
+        for (set<reg_id_t>::const_iterator it = dst_regs.begin();
+             it != dst_regs.end(); ++it)
         {
-            //pair<opnd_t, int>* pRecord = find_same_mem(mem_nc, *it);
-            //if (pRecord)
-            //    pRecord->second = ic + 1;
-            //else
-            //    mem_nc.push_back(pair<opnd_t, int>(*it, 1));
-            mem_nc = ic + 1;
+            reg_writer[*it] = idx;
+            alias_writer[full_reg(*it)] = make_pair(idx, *it);
         }
         
+        if (!dst_mems.empty())
+            mem_writer = idx;
+        
         for (set<int>::const_iterator it = write_eflags.begin();
              it != write_eflags.end(); ++it)
         {
-            eflags_nc[*it] = ic + 1;
+            eflags_writer[*it] = idx;
         }
         
         /* Increment the instruction count */
 	    ni++;
+	    prev = instr;
 	}
+
+    info->x87_top = (int8_t) x87.top;
+    for (int i = 0; i < 8; ++i)
+        info->x87_slot[i] = (int8_t) x87.slot[i];
+
+    if (prev != NULL && instr_is_cbr(prev))
+    {
+        info->cbr_pc = instr_get_app_pc(prev);
+        info->cbr_target = opnd_get_pc(instr_get_target(prev));
+        info->cbr_fall = info->cbr_pc
+            + instr_length(dr_get_current_drcontext(), prev);
+    }
 	
     if (nc > 0)
         ilp =  (ni * 1000) / nc;
     else /* no dependencies, all can execute in parallel */
         ilp = (ni * 1000);
+
+    info->dep_cycles = nc;
+    for (dep_graph::const_iterator it = graph.begin(); it != graph.end(); ++it)
+    {
+        if ((int) info->profile.size() <= it->start)
+            info->profile.resize(it->start + 1);
+        info->profile[it->start]++;
+    }
+
+    /* Loads issuing at the same depth cannot depend on each other */
+    map<int, int> load_depths;
+    for (dep_graph::const_iterator it = graph.begin(); it != graph.end(); ++it)
+    {
+        if (it->mem_srcs.empty())
+            continue;
+        info->loads++;
+        info->mlp_peak = _MAX(info->mlp_peak, ++load_depths[it->start]);
+    }
+    info->load_depths = (int32_t) load_depths.size();
+    info->port_cycles = uarch_port_bound(pressure);
+    info->sched_cycles = list_schedule(graph, options.issue_width);
+
+    register_pressure(info);
+    mix_critical_paths(info);
+
+    int false_nc = false_critical_path(info, -1);
+    info->false_ilp = (false_nc > 0) ? (ni * 1000) / false_nc : ni * 1000;
+
+    int fused_nc = fused_critical_path(graph);
+    info->fused_ni = ni - info->macro_fused;
+    info->fused_ilp = (fused_nc > 0) ? (info->fused_ni * 1000) / fused_nc
+                                     : info->fused_ni * 1000;
         
-    if (ilp < 1000)
+    /* With real latencies ILP may legitimately drop below 1, but the
+     * critical path can never be longer than running everything serially.
+     */
+    if (nc > sum_latency)
     {
         dr_fprintf(STDERR, "Assertion FAILED: ilp=%d\n", ilp);
         throw -1;
@@ -307,7 +2139,7 @@ preinsert_add64(void* dc, instrlist_t* bb, instr_t* pos,
 }
 
 static void
-update_ilp(int32_t ni, int32_t sum_offset)
+update_ilp(int32_t ni, int32_t sum_offset, block_info* info)
 {
 #ifdef THREAD_SAFE_CLEAN_CALLS
     dr_mutex_lock(stats_mutex);
@@ -315,32 +2147,108 @@ update_ilp(int32_t ni, int32_t sum_offset)
 
     stats.total_ni += ni;
     stats.sum_ilp += sum_offset;
+    info->exec_count++;
     
 #ifdef THREAD_SAFE_CLEAN_CALLS
     dr_mutex_unlock(stats_mutex);
 #endif
 }
 
+/* Block entry under the dynamic engine: one clean call does both the
+ * counters and the replay of the block that just finished.
+ */
+static void
+block_entry(int32_t ni, int32_t sum_offset, block_info* info)
+{
+    update_ilp(ni, sum_offset, info);
+    dynamic_block(dr_get_current_drcontext(), info);
+}
+
+static block_info*
+get_block_info(void* tag, instrlist_t* bb, bool for_trace)
+{
+    dr_mutex_lock(blocks_mutex);
+    block_info*& info = blocks[make_pair(tag, for_trace)];
+    if (info == NULL)
+    {
+        info = new block_info();
+        info->start_pc = instr_get_app_pc(instrlist_first(bb));
+        calculate_ilp(bb, info);
+        if (loops_enabled() && loop_closes(bb, info->start_pc))
+        {
+            loop_info*& loop = loops[make_pair(tag, for_trace)];
+            loop = new loop_info();
+            loop->head_pc = info->start_pc;
+            loop->head = info;
+            loop_analyse(bb, info, options.issue_width, loop);
+        }
+    }
+    dr_mutex_unlock(blocks_mutex);
+    return info;
+}
+
+/* A trace that jumps back to its head is one iteration of a loop whose
+ * body spans several blocks.  Iterations are counted by the head block's
+ * trace copy, which is built just before the trace itself.
+ */
+static dr_emit_flags_t
+event_trace(void *dc, void *tag, instrlist_t *trace, bool translating)
+{
+    app_pc head_pc = dr_fragment_app_pc(tag);
+    if (!loop_closes(trace, head_pc))
+        return DR_EMIT_DEFAULT;
+
+    dr_mutex_lock(blocks_mutex);
+    block_map::const_iterator head = blocks.find(make_pair(tag, true));
+    loop_map::iterator it = loops.find(make_pair(tag, true));
+    if (head != blocks.end()
+        && (it == loops.end() || it->second->trace == false))
+    {
+        block_info body = block_info();
+        calculate_ilp(trace, &body);
+
+        loop_info*& loop = loops[make_pair(tag, true)];
+        if (loop == NULL)
+            loop = new loop_info();
+        loop->head_pc = head_pc;
+        loop->trace = true;
+        loop->head = head->second;
+        loop_analyse(trace, &body, options.issue_width, loop);
+    }
+    dr_mutex_unlock(blocks_mutex);
+    return DR_EMIT_DEFAULT;
+}
+
 static dr_emit_flags_t
 event_basic_block(void *dc, void *tag, instrlist_t *bb,
                   bool for_trace, bool translating)
 {
-    int32_t num_instr = 0;
-    int32_t ilp = 0;
-    int32_t ilp_sum_offset = 0;
-    
-    calculate_ilp(bb, num_instr, ilp);
-    ilp_sum_offset = ilp * num_instr;
+    block_info* info = get_block_info(tag, bb, for_trace);
+    int32_t num_instr = info->ni;
+    int32_t ilp_sum_offset = info->ilp * num_instr;
 
     offline_stats.total_ni += num_instr;
     offline_stats.sum_ilp += ilp_sum_offset;
+
+    if (dynamic_enabled())
+    {
+        /* Address capture goes in first so the entry call precedes it */
+        dynamic_instrument(dc, bb);
+        dr_insert_clean_call(dc, bb, instrlist_first(bb),
+                             (void*) block_entry, false, 3,
+                             OPND_CREATE_INT32(num_instr),
+                             OPND_CREATE_INT32(ilp_sum_offset),
+                             OPND_CREATE_INTPTR(info));
+        return DR_EMIT_DEFAULT;
+    }
     
     instr_t* pos = instrlist_first(bb);
 
 #ifdef USE_CLEAN_CALLS
-    dr_insert_clean_call(dc, bb, pos, (void*) update_ilp, false, 2,
+    dr_insert_clean_call(dc, bb, pos, (void*) update_ilp, false, 3,
                          OPND_CREATE_INT32(num_instr),
-                         OPND_CREATE_INT32(ilp_sum_offset));
+                         OPND_CREATE_INT32(ilp_sum_offset),
+                         OPND_CREATE_INTPTR(info));
 #else
 #ifdef FIND_DEAD_EFLAGS
     bool dead_eflags_found = find_dead_eflags_instr(bb, pos);
@@ -351,6 +2259,7 @@ event_basic_block(void *dc, void *tag, instrlist_t *bb,
 
     preinsert_add64(dc, bb, pos, &stats.total_ni, num_instr);
     preinsert_add64(dc, bb, pos, &stats.sum_ilp, ilp_sum_offset);    
+    preinsert_add64(dc, bb, pos, &info->exec_count, 1);
 
 #ifdef FIND_DEAD_EFLAGS
     if (!dead_eflags_found)
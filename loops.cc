@@ -0,0 +1,376 @@
+#include "loops.h"
+#include "dynamic.h"
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+/* Memory operands get resource ids after the registers and flags */
+#define RES_MEM(idx)    (NUM_RESOURCES + (idx))
+
+typedef pair<int, int> carried_edge;    /* (producer, next-iteration reader) */
+
+const int unroll_factors[UNROLL_FACTORS] = { 2, 4, 8 };
+
+/* In-place updates that may be reassociated into partial accumulators */
+static bool
+is_reduction(int opcode)
+{
+    switch (opcode)
+    {
+    case OP_add: case OP_sub: case OP_inc: case OP_dec: case OP_imul:
+    case OP_and: case OP_or: case OP_xor:
+    case OP_addsd: case OP_subsd: case OP_mulsd:
+    case OP_addss: case OP_subss: case OP_mulss:
+    case OP_addpd: case OP_subpd: case OP_mulpd:
+    case OP_addps: case OP_subps: case OP_mulps:
+    case OP_vaddsd: case OP_vmulsd: case OP_vaddpd: case OP_vmulpd:
+    case OP_vfmadd231sd: case OP_vfmadd231pd:
+    case OP_paddd: case OP_paddq: case OP_psubd: case OP_pand: case OP_por:
+        return true;
+    }
+    return false;
+}
+
+static bool
+is_fp_reduction(int opcode)
+{
+    switch (opcode)
+    {
+    case OP_addsd: case OP_subsd: case OP_mulsd:
+    case OP_addss: case OP_subss: case OP_mulss:
+    case OP_addpd: case OP_subpd: case OP_mulpd:
+    case OP_addps: case OP_subps: case OP_mulps:
+    case OP_vaddsd: case OP_vmulsd: case OP_vaddpd: case OP_vmulpd:
+    case OP_vfmadd231sd: case OP_vfmadd231pd:
+        return true;
+    }
+    return false;
+}
+
+bool
+loop_closes(instrlist_t* body, app_pc head_pc)
+{
+    instr_t* last = NULL;
+    for (instr_t* instr = instrlist_first(body);
+         instr != NULL; instr = instr_get_next(instr))
+    {
+        if (instr_ok_to_mangle(instr))
+            last = instr;
+    }
+    if (last == NULL || !(instr_is_cbr(last) || instr_is_ubr(last)))
+        return false;
+    opnd_t target = instr_get_target(last);
+    return opnd_is_pc(target) && opnd_get_pc(target) == head_pc;
+}
+
+/* General-purpose registers by their full-size alias: writing eax
+ * changes an address formed from rax
+ */
+static int
+reg_key(int res)
+{
+    if (res <= DR_REG_LAST_VALID_ENUM && reg_is_gpr((reg_id_t) res))
+        return reg_to_pointer_sized((reg_id_t) res);
+    return res;
+}
+
+static bool
+writes_any(const dep_graph& graph, reg_id_t reg)
+{
+    for (dep_graph::const_iterator it = graph.begin(); it != graph.end(); ++it)
+    {
+        for (vector<uint16_t>::const_iterator res = it->dst_res.begin();
+             res != it->dst_res.end(); ++res)
+        {
+            if (reg_key(*res) == reg_key(reg))
+                return true;
+        }
+    }
+    return false;
+}
+
+/* Resource id of a memory operand whose address is the same in every
+ * iteration, or -1 if its base or index register changes in the body.
+ */
+static int
+invariant_mem(const dep_graph& graph, vector<opnd_t>& mems, opnd_t opnd)
+{
+    if (opnd_is_base_disp(opnd)
+        && ((opnd_get_base(opnd) != DR_REG_NULL
+             && writes_any(graph, opnd_get_base(opnd)))
+            || (opnd_get_index(opnd) != DR_REG_NULL
+                && writes_any(graph, opnd_get_index(opnd)))))
+        return -1;
+    for (size_t i = 0; i < mems.size(); ++i)
+    {
+        if (opnd_same_address(opnd, mems[i]))
+            return RES_MEM((int) i);
+    }
+    mems.push_back(opnd);
+    return RES_MEM((int) mems.size() - 1);
+}
+
+/* Longest latency path from node `from' to every later node, counting the
+ * latency of each node on the path but not of the end node itself, so
+ * dist[j] is how long after `from' issues node j can issue.  -1 marks
+ * nodes not reachable through true dependencies.
+ */
+static void
+longest_paths(const dep_graph& graph, int from, vector<int>& dist)
+{
+    int n = (int) graph.size();
+    dist.assign(n, -1);
+    dist[from] = 0;
+    for (int j = from + 1; j < n; ++j)
+    {
+        const vector<dep_edge>& preds = graph[j].preds;
+        for (vector<dep_edge>::const_iterator it = preds.begin();
+             it != preds.end(); ++it)
+        {
+            if ((it->kind & DEP_RAW) && dist[it->from] >= 0)
+                dist[j] = max(dist[j], dist[it->from]
+                                       + graph[it->from].latency);
+        }
+    }
+}
+
+/* Karp's maximum cycle mean.  Every edge spans one iteration, so the mean
+ * is latency per iteration around the worst recurrence; weight[a][b] < 0
+ * means there is no edge.
+ */
+static double
+max_cycle_mean(const vector< vector<int> >& weight)
+{
+    int n = (int) weight.size();
+    if (n == 0)
+        return 0;
+
+    /* walk[k][v]: heaviest walk of exactly k edges ending at v */
+    vector< vector<double> > walk(n + 1, vector<double>(n, -1));
+    walk[0].assign(n, 0);
+    for (int k = 1; k <= n; ++k)
+    {
+        for (int a = 0; a < n; ++a)
+        {
+            if (walk[k - 1][a] < 0)
+                continue;
+            for (int b = 0; b < n; ++b)
+            {
+                if (weight[a][b] >= 0)
+                    walk[k][b] = max(walk[k][b],
+                                     walk[k - 1][a] + weight[a][b]);
+            }
+        }
+    }
+
+    double best = 0;
+    for (int v = 0; v < n; ++v)
+    {
+        if (walk[n][v] < 0)
+            continue;
+        double worst = -1;
+        for (int k = 0; k < n; ++k)
+        {
+            if (walk[k][v] < 0)
+                continue;
+            double mean = (walk[n][v] - walk[k][v]) / (n - k);
+            if (worst < 0 || mean < worst)
+                worst = mean;
+        }
+        best = max(best, worst);
+    }
+    return best;
+}
+
+/* Critical path of `factor' back-to-back copies of the body.  Copy c
+ * takes the values carried by `carried' from copy c - 1; only the last
+ * copy keeps the closing branch.
+ */
+static int32_t
+unrolled_ilp(const dep_graph& graph, const vector<carried_edge>& carried,
+             int factor)
+{
+    int n = (int) graph.size();
+    vector< vector<int> > producers(n);
+    for (vector<carried_edge>::const_iterator it = carried.begin();
+         it != carried.end(); ++it)
+        producers[it->second].push_back(it->first);
+
+    vector<int> start(factor * n);
+    int nc = 0;
+    for (int c = 0; c < factor; ++c)
+    {
+        int* copy = &start[c * n];
+        for (int i = 0; i < n; ++i)
+        {
+            int ic = 0;
+            const vector<dep_edge>& preds = graph[i].preds;
+            for (vector<dep_edge>::const_iterator it = preds.begin();
+                 it != preds.end(); ++it)
+                ic = max(ic, copy[it->from] + graph[it->from].latency);
+            for (vector<int>::const_iterator it = producers[i].begin();
+                 c > 0 && it != producers[i].end(); ++it)
+                ic = max(ic, copy[*it - n] + graph[*it].latency);
+            copy[i] = ic;
+            if (i != n - 1 || c == factor - 1)
+                nc = max(nc, ic + graph[i].latency);
+        }
+    }
+
+    int ni = factor * (n - 1) + 1;
+    return (nc > 0) ? (ni * 1000) / nc : ni * 1000;
+}
+
+/* Edge a -> b: a's reader starts an iteration, the path through that
+ * iteration reaches b's producer, whose result feeds the next one.
+ */
+static double
+recurrence_mii(const dep_graph& graph, const set<carried_edge>& carried)
+{
+    vector<carried_edge> edges(carried.begin(), carried.end());
+    int ne = (int) edges.size();
+    vector< vector<int> > weight(ne, vector<int>(ne, -1));
+    vector<int> dist;
+    for (int a = 0; a < ne; ++a)
+    {
+        longest_paths(graph, edges[a].second, dist);
+        for (int b = 0; b < ne; ++b)
+        {
+            int producer = edges[b].first;
+            if (dist[producer] >= 0)
+                weight[a][b] = dist[producer] + graph[producer].latency;
+        }
+    }
+    return max_cycle_mean(weight);
+}
+
+void
+loop_analyse(instrlist_t* body, const block_info* iteration,
+             int issue_width, loop_info* loop)
+{
+    const dep_graph& graph = iteration->graph;
+    map<int, int> last_writer;
+    map<int, vector<int> > exposed;     /* reads before the first write */
+    map<int, vector<int> > overwrite;   /* writes before any read or write */
+    map<int, int> nreads;
+    vector<opnd_t> mems;
+
+    int idx = 0;
+    for (instr_t* instr = instrlist_first(body);
+         instr != NULL; instr = instr_get_next(instr))
+    {
+        if (!instr_ok_to_mangle(instr))
+            continue;
+        const dep_node& node = graph[idx];
+        vector<int> reads(node.src_res.begin(), node.src_res.end());
+        vector<int> writes(node.dst_res.begin(), node.dst_res.end());
+
+        vector<mem_ref> refs;
+        collect_mem_refs(instr, refs);
+        for (vector<mem_ref>::const_iterator it = refs.begin();
+             it != refs.end(); ++it)
+        {
+            int res = invariant_mem(graph, mems, it->opnd);
+            if (res < 0)
+                continue;
+            if (it->read)
+                reads.push_back(res);
+            if (it->write)
+                writes.push_back(res);
+        }
+
+        for (vector<int>::const_iterator it = reads.begin();
+             it != reads.end(); ++it)
+        {
+            if (last_writer.count(*it) == 0)
+                exposed[*it].push_back(idx);
+            nreads[*it]++;
+        }
+        for (vector<int>::const_iterator it = writes.begin();
+             it != writes.end(); ++it)
+        {
+            /* calculate_ilp orders register and memory writes (WAW) */
+            if (last_writer.count(*it) == 0 && exposed.count(*it) == 0
+                && (*it < RES_FLAG(1) || *it >= RES_MEM(0)))
+                overwrite[*it].push_back(idx);
+            last_writer[*it] = idx;
+        }
+        ++idx;
+    }
+
+    set<carried_edge> carried, reductions;
+    for (map<int, vector<int> >::const_iterator it = exposed.begin();
+         it != exposed.end(); ++it)
+    {
+        map<int, int>::const_iterator w = last_writer.find(it->first);
+        if (w == last_writer.end())
+            continue;
+        if (nreads[it->first] == 1 && it->second[0] == w->second
+            && is_reduction(graph[w->second].opcode))
+        {
+            reductions.insert(make_pair(w->second, w->second));
+            continue;
+        }
+        for (vector<int>::const_iterator r = it->second.begin();
+             r != it->second.end(); ++r)
+            carried.insert(make_pair(w->second, *r));
+    }
+
+    /* Unrolled copies also keep calculate_ilp's write-after-write order */
+    set<carried_edge> ordered(carried);
+    for (map<int, vector<int> >::const_iterator it = overwrite.begin();
+         it != overwrite.end(); ++it)
+    {
+        int w = last_writer[it->first];
+        for (vector<int>::const_iterator f = it->second.begin();
+             f != it->second.end(); ++f)
+            ordered.insert(make_pair(w, *f));
+    }
+    vector<carried_edge> split(ordered.begin(), ordered.end());
+    vector<carried_edge> whole(split);
+    whole.insert(whole.end(), reductions.begin(), reductions.end());
+    for (int f = 0; f < UNROLL_FACTORS; ++f)
+    {
+        loop->unroll_ilp[f] = unrolled_ilp(graph, whole, unroll_factors[f]);
+        loop->split_ilp[f] = unrolled_ilp(graph, split, unroll_factors[f]);
+    }
+    loop->accumulators = (int32_t) reductions.size();
+    carried.insert(reductions.begin(), reductions.end());
+
+    loop->rec_mii = recurrence_mii(graph, carried);
+
+    /* FP reductions are isolated self-recurrences, an accumulator only
+     * read by its own update, so with k accumulators each of them bounds
+     * the interval by latency / k and the rest stays as it is.
+     */
+    set<carried_edge> others(carried);
+    loop->fp_reductions = 0;
+    loop->fp_chain_latency = 0;
+    for (set<carried_edge>::const_iterator it = reductions.begin();
+         it != reductions.end(); ++it)
+    {
+        const dep_node& node = graph[it->first];
+        if (!is_fp_reduction(node.opcode))
+            continue;
+        loop->fp_reductions++;
+        if (node.latency > loop->fp_chain_latency)
+        {
+            loop->fp_chain_latency = node.latency;
+            loop->fp_opcode = node.opcode;
+        }
+        others.erase(*it);
+    }
+    loop->rec_mii_other = (loop->fp_reductions > 0)
+        ? recurrence_mii(graph, others) : loop->rec_mii;
+
+    loop->ni = iteration->ni;
+    loop->ilp = iteration->ilp;
+    loop->recurrences = (int32_t) carried.size();
+    loop->res_mii = max((double) iteration->port_cycles / 1000,
+                        (double) iteration->ni / issue_width);
+}
@@ -0,0 +1,54 @@
+#ifndef ILP_LOOPS_H
+#define ILP_LOOPS_H
+
+#include "dr_api.h"
+#include "block.h"
+
+/* Loop-carried recurrence analysis.
+ *
+ * A loop is a block or trace whose closing branch jumps back to its own
+ * first instruction, so the fragment is exactly one iteration.  A resource
+ * that the body reads before writing it, and writes later on, carries a
+ * value into the next iteration: registers, flag bits, and memory operands
+ * whose address registers the body never writes.  Cycles through these
+ * carried edges bound the initiation interval from below (RecMII); port
+ * pressure and issue width bound it too (ResMII).
+ *
+ * The unroll what-if lays out unroll_factors[] copies of the body with a
+ * single closing branch and measures the critical path of the result the
+ * way calculate_ilp would.  Splitting gives every copy its own copy of
+ * each accumulator, a resource only updated in place by one associative
+ * instruction (sums, products, logic reductions), which cuts its chain.
+ * Reassociating a floating-point reduction needs -ffast-math or a hand
+ * rewrite, so those are also reported on their own.
+ */
+/* Unroll factors of the what-if analysis */
+#define UNROLL_FACTORS  3
+extern const int unroll_factors[UNROLL_FACTORS];
+
+typedef struct {
+    app_pc            head_pc;
+    bool              trace;
+    int32_t           ni;
+    int32_t           ilp;          /* x1000, one iteration in isolation */
+    int32_t           recurrences;  /* carried producer/consumer pairs */
+    double            rec_mii;      /* cycles per iteration, recurrences */
+    double            res_mii;      /* cycles per iteration, resources */
+    int32_t           accumulators; /* reductions that could be split */
+    int32_t           fp_reductions;    /* of which floating point */
+    int32_t           fp_chain_latency; /* longest FP reduction step */
+    int               fp_opcode;        /* its opcode */
+    double            rec_mii_other;    /* RecMII without FP reductions */
+    int32_t           unroll_ilp[UNROLL_FACTORS];   /* x1000 */
+    int32_t           split_ilp[UNROLL_FACTORS];    /* x1000 */
+    const block_info* head;         /* its exec_count counts iterations */
+} loop_info;
+
+/* True if the last application instruction branches back to head_pc */
+bool loop_closes(instrlist_t* body, app_pc head_pc);
+
+/* Fills in loop from one iteration's instructions and dependency graph */
+void loop_analyse(instrlist_t* body, const block_info* iteration,
+                  int issue_width, loop_info* loop);
+
+#endif /* ILP_LOOPS_H */
@@ -0,0 +1,51 @@
+#include "mix.h"
+#include "simd.h"
+
+static bool
+is_string_op(int opcode)
+{
+    switch (opcode)
+    {
+    case OP_movs: case OP_rep_movs: case OP_stos: case OP_rep_stos:
+    case OP_lods: case OP_rep_lods:
+    case OP_cmps: case OP_rep_cmps: case OP_repne_cmps:
+    case OP_scas: case OP_rep_scas: case OP_repne_scas:
+        return true;
+    }
+    return false;
+}
+
+int
+mix_classify(instr_t* instr)
+{
+    int opcode = instr_get_opcode(instr);
+    if (instr_is_cti(instr))
+        return MIX_BRANCH;
+    if (is_string_op(opcode))
+        return MIX_STRING;
+    /* Every x87 mnemonic starts with f, no SSE or integer one does */
+    if (decode_opcode_name(opcode)[0] == 'f')
+        return MIX_X87;
+
+    simd_class simd;
+    simd_classify(instr, &simd);
+    if (simd.width > 0)
+        return (simd.width >= 128 && !simd.scalar) ? MIX_SIMD : MIX_FP;
+
+    if (instr_writes_memory(instr))
+        return MIX_STORE;
+    if (instr_reads_memory(instr))
+        return (opcode == OP_mov_ld || opcode == OP_movzx
+                || opcode == OP_movsx || opcode == OP_pop)
+               ? MIX_LOAD : MIX_INT;
+    return MIX_INT;
+}
+
+const char*
+mix_name(int mix)
+{
+    static const char* const names[MIX_CLASSES] = {
+        "branch", "string", "x87", "simd", "fp", "store", "load", "int"
+    };
+    return (mix >= 0 && mix < MIX_CLASSES) ? names[mix] : "?";
+}
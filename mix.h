@@ -0,0 +1,25 @@
+#ifndef ILP_MIX_H
+#define ILP_MIX_H
+
+#include "dr_api.h"
+
+/* Instruction classes for the mix breakdown.  Every instruction gets
+ * exactly one, the first that applies in enum order: a load+op stays in
+ * its compute class, a movsd load counts as FP scalar.
+ */
+enum {
+    MIX_BRANCH,
+    MIX_STRING,
+    MIX_X87,
+    MIX_SIMD,       /* packed SSE/AVX */
+    MIX_FP,         /* scalar SSE */
+    MIX_STORE,
+    MIX_LOAD,
+    MIX_INT,
+    MIX_CLASSES
+};
+
+int mix_classify(instr_t* instr);
+const char* mix_name(int mix);
+
+#endif /* ILP_MIX_H */
@@ -0,0 +1,104 @@
+#include "sched.h"
+
+#include <algorithm>
+
+using namespace std;
+
+/* Claims one free port for each uop, all or nothing */
+static bool
+assign_ports(const vector<uint16_t>& uops, uint32_t& busy)
+{
+    uint32_t claimed = busy;
+    for (vector<uint16_t>::const_iterator it = uops.begin();
+         it != uops.end(); ++it)
+    {
+        uint32_t free = *it & ~claimed;
+        if (free == 0)
+            return false;
+        claimed |= free & (~free + 1);
+    }
+    busy = claimed;
+    return true;
+}
+
+struct by_priority {
+    const vector<int>& height;
+    by_priority(const vector<int>& h) : height(h) {}
+    bool operator()(int a, int b) const
+    {
+        if (height[a] != height[b])
+            return height[a] > height[b];
+        return a < b;
+    }
+};
+
+int32_t
+list_schedule(const dep_graph& graph, int issue_width)
+{
+    int n = (int) graph.size();
+    vector< vector<int> > succs(n);
+    vector<int> npreds(n), height(n), ready_at(n, 0);
+
+    for (int i = 0; i < n; ++i)
+    {
+        const vector<dep_edge>& preds = graph[i].preds;
+        npreds[i] = (int) preds.size();
+        for (vector<dep_edge>::const_iterator it = preds.begin();
+             it != preds.end(); ++it)
+            succs[it->from].push_back(i);
+    }
+
+    /* Priority: longest latency-weighted path from the node to a sink */
+    for (int i = n - 1; i >= 0; --i)
+    {
+        int tail = 0;
+        for (vector<int>::const_iterator it = succs[i].begin();
+             it != succs[i].end(); ++it)
+            tail = max(tail, height[*it]);
+        height[i] = graph[i].latency + tail;
+    }
+
+    vector<int> ready;
+    for (int i = 0; i < n; ++i)
+    {
+        if (npreds[i] == 0)
+            ready.push_back(i);
+    }
+
+    int32_t finish = 0;
+    int scheduled = 0;
+    for (int cycle = 0; scheduled < n; ++cycle)
+    {
+        sort(ready.begin(), ready.end(), by_priority(height));
+
+        uint32_t busy = 0;
+        int issued = 0;
+        vector<int> waiting, woken;
+        for (vector<int>::const_iterator it = ready.begin();
+             it != ready.end(); ++it)
+        {
+            int i = *it;
+            if (issued == issue_width || ready_at[i] > cycle
+                || !assign_ports(graph[i].uops, busy))
+            {
+                waiting.push_back(i);
+                continue;
+            }
+
+            int done = cycle + graph[i].latency;
+            finish = max(finish, done);
+            ++issued;
+            ++scheduled;
+            for (vector<int>::const_iterator s = succs[i].begin();
+                 s != succs[i].end(); ++s)
+            {
+                ready_at[*s] = max(ready_at[*s], done);
+                if (--npreds[*s] == 0)
+                    woken.push_back(*s);
+            }
+        }
+        ready.swap(waiting);
+        ready.insert(ready.end(), woken.begin(), woken.end());
+    }
+    return finish;
+}
@@ -0,0 +1,13 @@
+#ifndef ILP_SCHED_H
+#define ILP_SCHED_H
+
+#include "depgraph.h"
+
+/* Resource-constrained list scheduler.  Issues at most issue_width
+ * instructions per cycle, each uop to a free port of the selected core,
+ * picking ready instructions by longest latency path to the end of the
+ * block.  Returns the cycle at which the last result is ready.
+ */
+int32_t list_schedule(const dep_graph& graph, int issue_width);
+
+#endif /* ILP_SCHED_H */
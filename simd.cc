@@ -0,0 +1,133 @@
+#include "simd.h"
+
+#include <string.h>
+
+static bool
+ends_with(const char* name, size_t len, const char* suffix)
+{
+    size_t n = strlen(suffix);
+    return len >= n && strcmp(name + len - n, suffix) == 0;
+}
+
+/* Packed-integer ops on the whole register, without an element size */
+static const char* const whole_register_ops[] = {
+    "pand", "pandn", "por", "pxor", "ptest",
+    "movdqa", "movdqu", "lddqu", "movntdq", "movntdqa",
+};
+
+#define WHOLE_REGISTER_BITS 64
+
+static bool
+is_op(const char* name, const char* const* ops, size_t num_ops)
+{
+    /* The VEX form is the legacy name with a v in front */
+    if (name[0] == 'v')
+        name++;
+    for (size_t i = 0; i < num_ops; ++i)
+    {
+        if (strcmp(name, ops[i]) == 0)
+            return true;
+    }
+    return false;
+}
+
+/* Element bits implied by the mnemonic, 0 if unknown */
+static int
+element_bits(const char* name, bool* scalar)
+{
+    static const char* const moves_32[] = { "movd" };
+    static const char* const moves_64[] = { "movq" };
+    size_t len = strlen(name);
+    *scalar = false;
+    if (is_op(name, whole_register_ops,
+              sizeof(whole_register_ops) / sizeof(whole_register_ops[0])))
+        return WHOLE_REGISTER_BITS;
+    if (is_op(name, moves_32, 1) || is_op(name, moves_64, 1))
+    {
+        *scalar = true;
+        return is_op(name, moves_32, 1) ? 32 : 64;
+    }
+    /* Packed integer before the FP suffixes, so pminsd is not a scalar
+     * double; the p-prefixed permutes of FP data keep their ps/pd.
+     */
+    bool fp = ends_with(name, len, "pd") || ends_with(name, len, "ps");
+    if (!fp && (name[0] == 'p' || (name[0] == 'v' && name[1] == 'p')))
+    {
+        switch (name[len - 1])
+        {
+        case 'b': return 8;
+        case 'w': return 16;
+        case 'd': return 32;
+        case 'q': return 64;
+        }
+        return 0;
+    }
+    if (ends_with(name, len, "pd"))
+        return 64;
+    if (ends_with(name, len, "ps"))
+        return 32;
+    if (ends_with(name, len, "sd"))
+    {
+        *scalar = true;
+        return 64;
+    }
+    if (ends_with(name, len, "ss"))
+    {
+        *scalar = true;
+        return 32;
+    }
+    return 0;
+}
+
+static int
+operand_bits(opnd_t opnd)
+{
+    if (opnd_is_reg(opnd))
+    {
+        reg_id_t reg = opnd_get_reg(opnd);
+        if (reg_is_ymm(reg))
+            return 256;
+        if (reg_is_xmm(reg))
+            return 128;
+        return 0;
+    }
+    if (opnd_is_memory_reference(opnd))
+    {
+        opnd_size_t size = opnd_get_size(opnd);
+        if (size == OPSZ_32)
+            return 256;
+        if (size == OPSZ_16)
+            return 128;
+    }
+    return 0;
+}
+
+void
+simd_classify(instr_t* instr, simd_class* simd)
+{
+    int width = 0;
+    for (int i = 0; i < instr_num_srcs(instr); ++i)
+    {
+        int bits = operand_bits(instr_get_src(instr, i));
+        if (bits > width)
+            width = bits;
+    }
+    for (int i = 0; i < instr_num_dsts(instr); ++i)
+    {
+        int bits = operand_bits(instr_get_dst(instr, i));
+        if (bits > width)
+            width = bits;
+    }
+
+    simd->width = width;
+    simd->elem = 0;
+    simd->lanes = 1;
+    simd->scalar = false;
+    if (width == 0)
+        return;
+
+    simd->elem = element_bits(decode_opcode_name(instr_get_opcode(instr)),
+                              &simd->scalar);
+    if (simd->elem > 0 && !simd->scalar)
+        simd->lanes = width / simd->elem;
+}
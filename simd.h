@@ -0,0 +1,26 @@
+#ifndef ILP_SIMD_H
+#define ILP_SIMD_H
+
+#include "dr_api.h"
+
+/* Data-level parallelism of an instruction.  Element size is taken from
+ * the SSE/AVX mnemonic suffix (pd/ps, sd/ss, and b/w/d/q on p-prefixed
+ * integer ops); vector width from the widest xmm/ymm or memory operand.
+ * Bitwise logicals and whole-register moves (pand, pxor, movdqa, ...) have
+ * no element size of their own and count in 64-bit lanes; movd/movq only
+ * move one element.  Everything else is scalar: one lane.
+ */
+
+/* Register width the utilisation metric is measured against */
+#define SIMD_MAX_BITS 256
+
+typedef struct {
+    int width;      /* bits of the widest vector operand, 0: not SIMD */
+    int elem;       /* element bits, 0 if not SIMD or unknown */
+    int lanes;      /* elements operated on */
+    bool scalar;    /* scalar form on vector registers: sd/ss, movd/movq */
+} simd_class;
+
+void simd_classify(instr_t* instr, simd_class* simd);
+
+#endif /* ILP_SIMD_H */
@@ -0,0 +1,579 @@
+#include "uarch.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/* Latencies are register-to-register figures in cycles, taken from the
+ * usual published instruction tables.  Anything not listed costs 1 cycle.
+ */
+
+static constexpr uarch_latency unit_latencies[] = {
+    { OP_INVALID, 1 },
+};
+
+static constexpr uarch_latency nehalem_latencies[] = {
+    { OP_imul, 3 },     { OP_mul, 3 },
+    { OP_div, 26 },     { OP_idiv, 26 },
+    { OP_popcnt, 3 },   { OP_bsf, 3 },      { OP_bsr, 3 },
+    { OP_addsd, 3 },    { OP_subsd, 3 },    { OP_mulsd, 5 },
+    { OP_divsd, 22 },   { OP_sqrtsd, 32 },
+    { OP_addss, 3 },    { OP_subss, 3 },    { OP_mulss, 4 },
+    { OP_divss, 14 },   { OP_sqrtss, 18 },
+    { OP_addpd, 3 },    { OP_subpd, 3 },    { OP_mulpd, 5 },
+    { OP_divpd, 22 },
+    { OP_addps, 3 },    { OP_subps, 3 },    { OP_mulps, 4 },
+    { OP_divps, 14 },
+    { OP_maxsd, 3 },    { OP_minsd, 3 },
+    { OP_ucomisd, 1 },  { OP_comisd, 1 },
+    { OP_cvtsi2sd, 4 }, { OP_cvttsd2si, 4 },
+    { OP_cvtsd2ss, 4 }, { OP_cvtss2sd, 1 },
+    { OP_fadd, 3 },     { OP_faddp, 3 },
+    { OP_fsub, 3 },     { OP_fsubp, 3 },    { OP_fsubr, 3 },  { OP_fsubrp, 3 },
+    { OP_fmul, 5 },     { OP_fmulp, 5 },
+    { OP_fdiv, 24 },    { OP_fdivp, 24 },   { OP_fdivr, 24 }, { OP_fdivrp, 24 },
+    { OP_fsqrt, 27 },
+};
+
+static constexpr uarch_latency sandybridge_latencies[] = {
+    { OP_imul, 3 },     { OP_mul, 3 },
+    { OP_div, 26 },     { OP_idiv, 26 },
+    { OP_popcnt, 3 },   { OP_bsf, 3 },      { OP_bsr, 3 },
+    { OP_addsd, 3 },    { OP_subsd, 3 },    { OP_mulsd, 5 },
+    { OP_divsd, 22 },   { OP_sqrtsd, 21 },
+    { OP_addss, 3 },    { OP_subss, 3 },    { OP_mulss, 5 },
+    { OP_divss, 14 },   { OP_sqrtss, 14 },
+    { OP_addpd, 3 },    { OP_subpd, 3 },    { OP_mulpd, 5 },
+    { OP_divpd, 22 },
+    { OP_addps, 3 },    { OP_subps, 3 },    { OP_mulps, 5 },
+    { OP_divps, 14 },
+    { OP_maxsd, 3 },    { OP_minsd, 3 },
+    { OP_ucomisd, 2 },  { OP_comisd, 2 },
+    { OP_cvtsi2sd, 4 }, { OP_cvttsd2si, 4 },
+    { OP_cvtsd2ss, 4 }, { OP_cvtss2sd, 1 },
+    { OP_vaddsd, 3 },   { OP_vmulsd, 5 },   { OP_vdivsd, 22 },
+    { OP_vaddpd, 3 },   { OP_vmulpd, 5 },   { OP_vdivpd, 43 },
+    { OP_vsqrtsd, 21 },
+    { OP_fadd, 3 },     { OP_faddp, 3 },
+    { OP_fsub, 3 },     { OP_fsubp, 3 },    { OP_fsubr, 3 },  { OP_fsubrp, 3 },
+    { OP_fmul, 5 },     { OP_fmulp, 5 },
+    { OP_fdiv, 24 },    { OP_fdivp, 24 },   { OP_fdivr, 24 }, { OP_fdivrp, 24 },
+    { OP_fsqrt, 24 },
+};
+
+static constexpr uarch_latency haswell_latencies[] = {
+    { OP_imul, 3 },     { OP_mul, 4 },
+    { OP_div, 26 },     { OP_idiv, 26 },
+    { OP_popcnt, 3 },   { OP_lzcnt, 3 },    { OP_tzcnt, 3 },
+    { OP_bsf, 3 },      { OP_bsr, 3 },
+    { OP_addsd, 3 },    { OP_subsd, 3 },    { OP_mulsd, 5 },
+    { OP_divsd, 14 },   { OP_sqrtsd, 16 },
+    { OP_addss, 3 },    { OP_subss, 3 },    { OP_mulss, 5 },
+    { OP_divss, 11 },   { OP_sqrtss, 11 },
+    { OP_addpd, 3 },    { OP_subpd, 3 },    { OP_mulpd, 5 },
+    { OP_divpd, 14 },
+    { OP_addps, 3 },    { OP_subps, 3 },    { OP_mulps, 5 },
+    { OP_divps, 11 },
+    { OP_maxsd, 3 },    { OP_minsd, 3 },
+    { OP_ucomisd, 3 },  { OP_comisd, 3 },
+    { OP_cvtsi2sd, 4 }, { OP_cvttsd2si, 4 },
+    { OP_cvtsd2ss, 4 }, { OP_cvtss2sd, 2 },
+    { OP_vaddsd, 3 },   { OP_vmulsd, 5 },   { OP_vdivsd, 14 },
+    { OP_vaddpd, 3 },   { OP_vmulpd, 5 },   { OP_vdivpd, 25 },
+    { OP_vsqrtsd, 16 },
+    { OP_vfmadd231sd, 5 }, { OP_vfmadd231pd, 5 },
+    { OP_fadd, 3 },     { OP_faddp, 3 },
+    { OP_fsub, 3 },     { OP_fsubp, 3 },    { OP_fsubr, 3 },  { OP_fsubrp, 3 },
+    { OP_fmul, 5 },     { OP_fmulp, 5 },
+    { OP_fdiv, 15 },    { OP_fdivp, 15 },   { OP_fdivr, 15 }, { OP_fdivrp, 15 },
+    { OP_fsqrt, 19 },
+};
+
+static constexpr uarch_latency skylake_latencies[] = {
+    { OP_imul, 3 },     { OP_mul, 4 },
+    { OP_div, 26 },     { OP_idiv, 26 },
+    { OP_popcnt, 3 },   { OP_lzcnt, 3 },    { OP_tzcnt, 3 },
+    { OP_bsf, 3 },      { OP_bsr, 3 },
+    { OP_addsd, 4 },    { OP_subsd, 4 },    { OP_mulsd, 4 },
+    { OP_divsd, 14 },   { OP_sqrtsd, 18 },
+    { OP_addss, 4 },    { OP_subss, 4 },    { OP_mulss, 4 },
+    { OP_divss, 11 },   { OP_sqrtss, 12 },
+    { OP_addpd, 4 },    { OP_subpd, 4 },    { OP_mulpd, 4 },
+    { OP_divpd, 14 },
+    { OP_addps, 4 },    { OP_subps, 4 },    { OP_mulps, 4 },
+    { OP_divps, 11 },
+    { OP_maxsd, 4 },    { OP_minsd, 4 },
+    { OP_ucomisd, 2 },  { OP_comisd, 2 },
+    { OP_cvtsi2sd, 5 }, { OP_cvttsd2si, 6 },
+    { OP_cvtsd2ss, 5 }, { OP_cvtss2sd, 5 },
+    { OP_vaddsd, 4 },   { OP_vmulsd, 4 },   { OP_vdivsd, 14 },
+    { OP_vaddpd, 4 },   { OP_vmulpd, 4 },   { OP_vdivpd, 14 },
+    { OP_vsqrtsd, 18 },
+    { OP_vfmadd231sd, 4 }, { OP_vfmadd231pd, 4 },
+    { OP_fadd, 3 },     { OP_faddp, 3 },
+    { OP_fsub, 3 },     { OP_fsubp, 3 },    { OP_fsubr, 3 },  { OP_fsubrp, 3 },
+    { OP_fmul, 5 },     { OP_fmulp, 5 },
+    { OP_fdiv, 15 },    { OP_fdivp, 15 },   { OP_fdivr, 15 }, { OP_fdivrp, 15 },
+    { OP_fsqrt, 21 },
+};
+
+static constexpr uarch_latency zen2_latencies[] = {
+    { OP_imul, 3 },     { OP_mul, 3 },
+    { OP_div, 17 },     { OP_idiv, 17 },
+    { OP_popcnt, 1 },   { OP_lzcnt, 1 },    { OP_tzcnt, 2 },
+    { OP_bsf, 3 },      { OP_bsr, 4 },
+    { OP_addsd, 3 },    { OP_subsd, 3 },    { OP_mulsd, 3 },
+    { OP_divsd, 13 },   { OP_sqrtsd, 20 },
+    { OP_addss, 3 },    { OP_subss, 3 },    { OP_mulss, 3 },
+    { OP_divss, 10 },   { OP_sqrtss, 14 },
+    { OP_addpd, 3 },    { OP_subpd, 3 },    { OP_mulpd, 3 },
+    { OP_divpd, 13 },
+    { OP_addps, 3 },    { OP_subps, 3 },    { OP_mulps, 3 },
+    { OP_divps, 10 },
+    { OP_maxsd, 1 },    { OP_minsd, 1 },
+    { OP_ucomisd, 4 },  { OP_comisd, 4 },
+    { OP_cvtsi2sd, 4 }, { OP_cvttsd2si, 4 },
+    { OP_cvtsd2ss, 3 }, { OP_cvtss2sd, 3 },
+    { OP_vaddsd, 3 },   { OP_vmulsd, 3 },   { OP_vdivsd, 13 },
+    { OP_vaddpd, 3 },   { OP_vmulpd, 3 },   { OP_vdivpd, 13 },
+    { OP_vsqrtsd, 20 },
+    { OP_vfmadd231sd, 5 }, { OP_vfmadd231pd, 5 },
+    { OP_fadd, 5 },     { OP_faddp, 5 },
+    { OP_fsub, 5 },     { OP_fsubp, 5 },    { OP_fsubr, 5 },  { OP_fsubrp, 5 },
+    { OP_fmul, 5 },     { OP_fmulp, 5 },
+    { OP_fdiv, 15 },    { OP_fdivp, 15 },   { OP_fdivr, 15 }, { OP_fdivrp, 15 },
+    { OP_fsqrt, 22 },
+};
+
+/* Port numbering follows each vendor's own scheme.  Intel cores from
+ * Haswell on have ALUs on p0156, loads on p23, store-address on p237 and
+ * store-data on p4; earlier cores have three ALU ports (p015).  Zen 2 is
+ * numbered here as ALU0-3 = p0-3, AGU0-2 = p4-6, FP0-3 = p7-10.
+ */
+#define P(n) (1 << (n))
+
+static constexpr uarch_port nehalem_port_list[] = {
+    { OP_imul, P(1) },    { OP_mul, P(1) },
+    { OP_div, P(0) },     { OP_idiv, P(0) },
+    { OP_lea, P(0) },     { OP_popcnt, P(1) },
+    { OP_shl, P(0) | P(5) }, { OP_shr, P(0) | P(5) }, { OP_sar, P(0) | P(5) },
+    { OP_jmp, P(5) },     { OP_jmp_short, P(5) },
+    { OP_addsd, P(1) },   { OP_subsd, P(1) },   { OP_mulsd, P(0) },
+    { OP_divsd, P(0) },   { OP_sqrtsd, P(0) },
+    { OP_addpd, P(1) },   { OP_subpd, P(1) },   { OP_mulpd, P(0) },
+    { OP_divpd, P(0) },
+    { OP_ucomisd, P(1) }, { OP_comisd, P(1) },
+    { OP_cvtsi2sd, P(1) }, { OP_cvttsd2si, P(1) },
+    { OP_fadd, P(1) },    { OP_faddp, P(1) },   { OP_fsub, P(1) },
+    { OP_fsubp, P(1) },   { OP_fmul, P(0) },    { OP_fmulp, P(0) },
+    { OP_fdiv, P(0) },    { OP_fdivp, P(0) },   { OP_fsqrt, P(0) },
+};
+
+static constexpr uarch_port sandybridge_port_list[] = {
+    { OP_imul, P(1) },    { OP_mul, P(1) },
+    { OP_div, P(0) },     { OP_idiv, P(0) },
+    { OP_lea, P(0) | P(1) }, { OP_popcnt, P(1) },
+    { OP_shl, P(0) | P(5) }, { OP_shr, P(0) | P(5) }, { OP_sar, P(0) | P(5) },
+    { OP_jmp, P(5) },     { OP_jmp_short, P(5) },
+    { OP_addsd, P(1) },   { OP_subsd, P(1) },   { OP_mulsd, P(0) },
+    { OP_divsd, P(0) },   { OP_sqrtsd, P(0) },
+    { OP_addpd, P(1) },   { OP_subpd, P(1) },   { OP_mulpd, P(0) },
+    { OP_divpd, P(0) },
+    { OP_vaddsd, P(1) },  { OP_vmulsd, P(0) },  { OP_vdivsd, P(0) },
+    { OP_vaddpd, P(1) },  { OP_vmulpd, P(0) },  { OP_vdivpd, P(0) },
+    { OP_ucomisd, P(1) }, { OP_comisd, P(1) },
+    { OP_cvtsi2sd, P(1) }, { OP_cvttsd2si, P(1) },
+    { OP_shufpd, P(5) },  { OP_unpcklpd, P(5) },
+    { OP_fadd, P(1) },    { OP_faddp, P(1) },   { OP_fsub, P(1) },
+    { OP_fsubp, P(1) },   { OP_fmul, P(0) },    { OP_fmulp, P(0) },
+    { OP_fdiv, P(0) },    { OP_fdivp, P(0) },   { OP_fsqrt, P(0) },
+};
+
+static constexpr uarch_port haswell_port_list[] = {
+    { OP_imul, P(1) },    { OP_mul, P(1) },
+    { OP_div, P(0) },     { OP_idiv, P(0) },
+    { OP_lea, P(1) | P(5) }, { OP_popcnt, P(1) },
+    { OP_lzcnt, P(1) },   { OP_tzcnt, P(1) },
+    { OP_shl, P(0) | P(6) }, { OP_shr, P(0) | P(6) }, { OP_sar, P(0) | P(6) },
+    { OP_jmp, P(6) },     { OP_jmp_short, P(6) },
+    { OP_addsd, P(1) },   { OP_subsd, P(1) },
+    { OP_mulsd, P(0) | P(1) },
+    { OP_divsd, P(0) },   { OP_sqrtsd, P(0) },
+    { OP_addpd, P(1) },   { OP_subpd, P(1) },
+    { OP_mulpd, P(0) | P(1) },
+    { OP_divpd, P(0) },
+    { OP_vaddsd, P(1) },  { OP_vmulsd, P(0) | P(1) }, { OP_vdivsd, P(0) },
+    { OP_vaddpd, P(1) },  { OP_vmulpd, P(0) | P(1) }, { OP_vdivpd, P(0) },
+    { OP_vfmadd231sd, P(0) | P(1) }, { OP_vfmadd231pd, P(0) | P(1) },
+    { OP_ucomisd, P(0) }, { OP_comisd, P(0) },
+    { OP_cvtsi2sd, P(1) }, { OP_cvttsd2si, P(1) },
+    { OP_shufpd, P(5) },  { OP_unpcklpd, P(5) },
+    { OP_fadd, P(1) },    { OP_faddp, P(1) },   { OP_fsub, P(1) },
+    { OP_fsubp, P(1) },   { OP_fmul, P(0) },    { OP_fmulp, P(0) },
+    { OP_fdiv, P(0) },    { OP_fdivp, P(0) },   { OP_fsqrt, P(0) },
+};
+
+static constexpr uarch_port skylake_port_list[] = {
+    { OP_imul, P(1) },    { OP_mul, P(1) },
+    { OP_div, P(0) },     { OP_idiv, P(0) },
+    { OP_lea, P(1) | P(5) }, { OP_popcnt, P(1) },
+    { OP_lzcnt, P(1) },   { OP_tzcnt, P(1) },
+    { OP_shl, P(0) | P(6) }, { OP_shr, P(0) | P(6) }, { OP_sar, P(0) | P(6) },
+    { OP_jmp, P(6) },     { OP_jmp_short, P(6) },
+    { OP_addsd, P(0) | P(1) }, { OP_subsd, P(0) | P(1) },
+    { OP_mulsd, P(0) | P(1) },
+    { OP_divsd, P(0) },   { OP_sqrtsd, P(0) },
+    { OP_addpd, P(0) | P(1) }, { OP_subpd, P(0) | P(1) },
+    { OP_mulpd, P(0) | P(1) },
+    { OP_divpd, P(0) },
+    { OP_vaddsd, P(0) | P(1) }, { OP_vmulsd, P(0) | P(1) },
+    { OP_vdivsd, P(0) },
+    { OP_vaddpd, P(0) | P(1) }, { OP_vmulpd, P(0) | P(1) },
+    { OP_vdivpd, P(0) },
+    { OP_vfmadd231sd, P(0) | P(1) }, { OP_vfmadd231pd, P(0) | P(1) },
+    { OP_ucomisd, P(0) }, { OP_comisd, P(0) },
+    { OP_cvtsi2sd, P(0) | P(1) }, { OP_cvttsd2si, P(0) | P(1) },
+    { OP_shufpd, P(5) },  { OP_unpcklpd, P(5) },
+    { OP_fadd, P(5) },    { OP_faddp, P(5) },   { OP_fsub, P(5) },
+    { OP_fsubp, P(5) },   { OP_fmul, P(0) },    { OP_fmulp, P(0) },
+    { OP_fdiv, P(0) },    { OP_fdivp, P(0) },   { OP_fsqrt, P(0) },
+};
+
+static constexpr uarch_port zen2_port_list[] = {
+    { OP_imul, P(1) },    { OP_mul, P(1) },
+    { OP_div, P(2) },     { OP_idiv, P(2) },
+    { OP_jmp, P(0) | P(3) }, { OP_jmp_short, P(0) | P(3) },
+    { OP_addsd, P(9) | P(10) }, { OP_subsd, P(9) | P(10) },
+    { OP_mulsd, P(7) | P(8) },
+    { OP_divsd, P(10) },  { OP_sqrtsd, P(10) },
+    { OP_addpd, P(9) | P(10) }, { OP_subpd, P(9) | P(10) },
+    { OP_mulpd, P(7) | P(8) },
+    { OP_divpd, P(10) },
+    { OP_vaddsd, P(9) | P(10) }, { OP_vmulsd, P(7) | P(8) },
+    { OP_vdivsd, P(10) },
+    { OP_vaddpd, P(9) | P(10) }, { OP_vmulpd, P(7) | P(8) },
+    { OP_vdivpd, P(10) },
+    { OP_vfmadd231sd, P(7) | P(8) }, { OP_vfmadd231pd, P(7) | P(8) },
+    { OP_ucomisd, P(9) }, { OP_comisd, P(9) },
+    { OP_cvtsi2sd, P(10) }, { OP_cvttsd2si, P(10) },
+    { OP_shufpd, P(8) | P(9) }, { OP_unpcklpd, P(8) | P(9) },
+    { OP_fadd, P(9) },    { OP_faddp, P(9) },   { OP_fsub, P(9) },
+    { OP_fsubp, P(9) },   { OP_fmul, P(7) },    { OP_fmulp, P(7) },
+    { OP_fdiv, P(10) },   { OP_fdivp, P(10) },  { OP_fsqrt, P(10) },
+};
+
+#define PORT_MODEL(ports, alu, ld, sta, std, table) \
+    { ports, alu, ld, sta, std, table, sizeof(table) / sizeof(table[0]) }
+
+static constexpr uarch_port_model nehalem_ports = PORT_MODEL(6,
+    P(0) | P(1) | P(5), P(2), P(3), P(4), nehalem_port_list);
+static constexpr uarch_port_model sandybridge_ports = PORT_MODEL(6,
+    P(0) | P(1) | P(5), P(2) | P(3), P(2) | P(3), P(4),
+    sandybridge_port_list);
+static constexpr uarch_port_model haswell_ports = PORT_MODEL(8,
+    P(0) | P(1) | P(5) | P(6), P(2) | P(3), P(2) | P(3) | P(7), P(4),
+    haswell_port_list);
+static constexpr uarch_port_model skylake_ports = PORT_MODEL(8,
+    P(0) | P(1) | P(5) | P(6), P(2) | P(3), P(2) | P(3) | P(7), P(4),
+    skylake_port_list);
+static constexpr uarch_port_model zen2_ports = PORT_MODEL(11,
+    P(0) | P(1) | P(2) | P(3), P(4) | P(5), P(6), 0, zen2_port_list);
+
+#define UARCH_DESC(name, load, table, ports, fusion) \
+    { name, load, table, sizeof(table) / sizeof(table[0]), ports, fusion }
+
+#define FUSE_INTEL_OLD (FUSE_CMP_JCC | FUSE_LOAD_OP)
+#define FUSE_INTEL     (FUSE_CMP_JCC | FUSE_ALU_JCC | FUSE_LOAD_OP)
+
+/* "unit" is the original latency model: every instruction takes one cycle
+ * and loads are free.  The critical path now ends when the last result is
+ * ready rather than when the last instruction issues, so a dependent chain
+ * of n instructions counts n cycles, not n - 1, and unit ILP is lower than
+ * before for every block with a dependency.
+ */
+static constexpr uarch_desc uarch_descs[] = {
+    UARCH_DESC("unit",        0, unit_latencies,        NULL,
+               FUSE_INTEL_OLD),
+    UARCH_DESC("nehalem",     4, nehalem_latencies,     &nehalem_ports,
+               FUSE_INTEL_OLD),
+    UARCH_DESC("sandybridge", 5, sandybridge_latencies, &sandybridge_ports,
+               FUSE_INTEL),
+    UARCH_DESC("haswell",     5, haswell_latencies,     &haswell_ports,
+               FUSE_INTEL),
+    UARCH_DESC("skylake",     5, skylake_latencies,     &skylake_ports,
+               FUSE_INTEL),
+    UARCH_DESC("zen2",        4, zen2_latencies,        &zen2_ports,
+               FUSE_CMP_JCC | FUSE_LOAD_OP),
+};
+
+#define NUM_UARCHS ((int) (sizeof(uarch_descs) / sizeof(uarch_descs[0])))
+
+uint8_t  uarch_latency_table[OP_LAST + 1];
+uint8_t  uarch_load_latency;
+uint16_t uarch_port_table[OP_LAST + 1];
+
+static const uarch_desc* selected;
+
+bool
+uarch_select(const char* name)
+{
+    for (int i = 0; i < NUM_UARCHS; ++i)
+    {
+        if (strcmp(uarch_descs[i].name, name) != 0)
+            continue;
+
+        selected = &uarch_descs[i];
+        memset(uarch_latency_table, 1, sizeof(uarch_latency_table));
+        for (int j = 0; j < selected->num_latencies; ++j)
+        {
+            const uarch_latency& entry = selected->latencies[j];
+            uarch_latency_table[entry.opcode] = entry.latency;
+        }
+        uarch_load_latency = selected->load_latency;
+
+        const uarch_port_model* model = selected->port_model;
+        for (int op = 0; op <= OP_LAST; ++op)
+            uarch_port_table[op] = (model != NULL) ? model->alu_ports : 0;
+        for (int j = 0; model != NULL && j < model->num_entries; ++j)
+            uarch_port_table[model->ports[j].opcode] = model->ports[j].ports;
+        return true;
+    }
+    return false;
+}
+
+const char*
+uarch_name(void)
+{
+    return selected == NULL ? "none" : selected->name;
+}
+
+void
+uarch_print_names(file_t f)
+{
+    for (int i = 0; i < NUM_UARCHS; ++i)
+        dr_fprintf(f, " %s", uarch_descs[i].name);
+    dr_fprintf(f, "\n");
+}
+
+bool
+uarch_has_ports(void)
+{
+    return selected != NULL && selected->port_model != NULL;
+}
+
+/* Moves with a memory operand are a bare load or store uop */
+static bool
+is_pure_move(int opcode)
+{
+    switch (opcode)
+    {
+    case OP_mov_ld: case OP_mov_st: case OP_movzx: case OP_movsx:
+    case OP_movsd: case OP_movss: case OP_movapd: case OP_movaps:
+    case OP_movupd: case OP_movups: case OP_movdqa: case OP_movdqu:
+    case OP_movd: case OP_movq: case OP_vmovapd: case OP_vmovupd:
+    case OP_vmovsd: case OP_push: case OP_pop:
+    case OP_fld: case OP_fst: case OP_fstp:
+        return true;
+    }
+    return false;
+}
+
+void
+uarch_instr_uops(instr_t* instr, std::vector<uint16_t>& uops)
+{
+    const uarch_port_model* model = selected->port_model;
+    if (model == NULL)
+        return;
+
+    bool reads_mem = instr_reads_memory(instr);
+    bool writes_mem = instr_writes_memory(instr);
+    int opcode = instr_get_opcode(instr);
+
+    if (!(is_pure_move(opcode) && (reads_mem || writes_mem))
+        && uarch_port_table[opcode] != 0)
+        uops.push_back(uarch_port_table[opcode]);
+    if (reads_mem && model->load_ports != 0)
+        uops.push_back(model->load_ports);
+    if (writes_mem)
+    {
+        if (model->store_addr_ports != 0)
+            uops.push_back(model->store_addr_ports);
+        if (model->store_data_ports != 0)
+            uops.push_back(model->store_data_ports);
+    }
+}
+
+static bool
+has_mem_and_imm(instr_t* instr)
+{
+    bool mem = false, imm = false;
+    for (int i = 0; i < instr_num_srcs(instr); ++i)
+    {
+        opnd_t opnd = instr_get_src(instr, i);
+        mem = mem || opnd_is_memory_reference(opnd);
+        imm = imm || opnd_is_immed(opnd);
+    }
+    return mem && imm;
+}
+
+/* Flag-setting instruction immediately followed by a conditional branch.
+ * jecxz/loop test a register rather than the flags and never fuse, nor
+ * does a flag-setter with both a memory operand and an immediate.
+ */
+bool
+uarch_macro_fuses(instr_t* first, instr_t* second)
+{
+    if (first == NULL || second == NULL || !instr_is_cbr(second))
+        return false;
+
+    int jcc = instr_get_opcode(second);
+    if (jcc == OP_jecxz || jcc == OP_loop || has_mem_and_imm(first))
+        return false;
+
+    switch (instr_get_opcode(first))
+    {
+    case OP_cmp: case OP_test:
+        return (selected->fusion & FUSE_CMP_JCC) != 0;
+    case OP_add: case OP_sub: case OP_and: case OP_inc: case OP_dec:
+        return (selected->fusion & FUSE_ALU_JCC) != 0;
+    }
+    return false;
+}
+
+/* One fused-domain uop carries both the load and the operation, or both
+ * the store address and store data.
+ */
+bool
+uarch_micro_fuses(instr_t* instr)
+{
+    if ((selected->fusion & FUSE_LOAD_OP) == 0)
+        return false;
+    if (instr_writes_memory(instr))
+        return true;
+    return instr_reads_memory(instr)
+        && !is_pure_move(instr_get_opcode(instr));
+}
+
+/* Lower bound on the cycles needed to issue the uops, in thousandths of a
+ * cycle: for every set of ports S, the uops that can only go to S need at
+ * least count / |S| cycles.  Checking every subset of the ports actually
+ * used is exact for this kind of bipartite assignment and cheap for the
+ * handful of ports a core has.
+ */
+int32_t
+uarch_port_bound(const port_pressure& pressure)
+{
+    uint16_t used = 0;
+    for (port_pressure::const_iterator it = pressure.begin();
+         it != pressure.end(); ++it)
+        used |= it->first;
+
+    int32_t bound = 0;
+    for (uint32_t s = used; s != 0; s = (s - 1) & used)
+    {
+        int uops = 0;
+        for (port_pressure::const_iterator it = pressure.begin();
+             it != pressure.end(); ++it)
+        {
+            if ((it->first & ~s) == 0)
+                uops += it->second;
+        }
+        int32_t cycles = (uops * 1000) / __builtin_popcount(s);
+        if (cycles > bound)
+            bound = cycles;
+    }
+    return bound;
+}
+
+static int
+find_opcode(const char* name)
+{
+    for (int op = OP_FIRST; op <= OP_LAST; ++op)
+    {
+        const char* op_name = decode_opcode_name(op);
+        if (op_name != NULL && strcmp(op_name, name) == 0)
+            return op;
+    }
+    return OP_INVALID;
+}
+
+/* Override file format, one entry per line, '#' starts a comment:
+ *
+ *     divsd 20
+ *     load  7      <- load-to-use latency added to memory sources
+ */
+static bool
+apply_override(const char* line, int lineno)
+{
+    char name[64];
+    int latency;
+
+    while (*line == ' ' || *line == '\t')
+        ++line;
+    if (*line == '\0' || *line == '#')
+        return true;
+
+    if (sscanf(line, "%63s %d", name, &latency) != 2
+        || latency < 0 || latency > 255)
+    {
+        dr_fprintf(STDERR, "ilp: bad latency override at line %d\n", lineno);
+        return false;
+    }
+
+    if (strcmp(name, "load") == 0)
+    {
+        uarch_load_latency = (uint8_t) latency;
+        return true;
+    }
+
+    int op = find_opcode(name);
+    if (op == OP_INVALID)
+    {
+        dr_fprintf(STDERR, "ilp: unknown opcode '%s' at line %d\n",
+            name, lineno);
+        return false;
+    }
+    uarch_latency_table[op] = (uint8_t) latency;
+    return true;
+}
+
+bool
+uarch_load_overrides(const char* path)
+{
+    file_t f = dr_open_file(path, DR_FILE_READ);
+    if (f == INVALID_FILE)
+    {
+        dr_fprintf(STDERR, "ilp: cannot open latency file %s\n", path);
+        return false;
+    }
+
+    uint64_t size = 0;
+    if (!dr_file_size(f, &size))
+    {
+        dr_close_file(f);
+        return false;
+    }
+
+    char* buf = new char[size + 1];
+    ssize_t nread = dr_read_file(f, buf, (size_t) size);
+    dr_close_file(f);
+    if (nread < 0)
+    {
+        delete[] buf;
+        return false;
+    }
+    buf[nread] = '\0';
+
+    bool ok = true;
+    int lineno = 1;
+    for (char* line = buf; ok && line != NULL; ++lineno)
+    {
+        char* eol = strchr(line, '\n');
+        if (eol != NULL)
+            *eol = '\0';
+        ok = apply_override(line, lineno);
+        line = (eol != NULL) ? eol + 1 : NULL;
+    }
+
+    delete[] buf;
+    return ok;
+}
@@ -0,0 +1,85 @@
+#ifndef ILP_UARCH_H
+#define ILP_UARCH_H
+
+#include "dr_api.h"
+
+#include <stdint.h>
+#include <map>
+#include <vector>
+
+/* Per-microarchitecture timing model.
+ *
+ * Every core is described by a constexpr list of (opcode, latency) pairs.
+ * uarch_select() expands the chosen list into a dense opcode-indexed table
+ * once at dr_init, and an optional override file is folded into the same
+ * table, so the analysis only ever pays one array load per instruction.
+ */
+
+typedef struct {
+    int     opcode;
+    uint8_t latency;
+} uarch_latency;
+
+/* Port model: each instruction issues one compute uop, restricted to the
+ * ports in its opcode's mask, plus a load uop if it reads memory and a
+ * store-address/store-data pair if it writes memory.  A zero mask means
+ * the uop does not exist on that core.
+ */
+typedef struct {
+    int      opcode;
+    uint16_t ports;
+} uarch_port;
+
+typedef struct {
+    int               num_ports;
+    uint16_t          alu_ports;         /* unlisted opcodes */
+    uint16_t          load_ports;
+    uint16_t          store_addr_ports;
+    uint16_t          store_data_ports;
+    const uarch_port* ports;
+    int               num_entries;
+} uarch_port_model;
+
+/* Fusion rules a core applies to adjacent instructions */
+enum {
+    FUSE_CMP_JCC = 0x1,     /* cmp/test + jcc */
+    FUSE_ALU_JCC = 0x2,     /* add/sub/and/inc/dec + jcc */
+    FUSE_LOAD_OP = 0x4,     /* load+op and store address+data */
+};
+
+typedef struct {
+    const char*             name;
+    uint8_t                 load_latency;   /* added to instrs reading memory */
+    const uarch_latency*    latencies;
+    int                     num_latencies;
+    const uarch_port_model* port_model;     /* NULL: unlimited ports */
+    uint8_t                 fusion;         /* FUSE_* rules */
+} uarch_desc;
+
+/* Uop counts keyed by the mask of ports they may issue to */
+typedef std::map<uint16_t, int> port_pressure;
+
+extern uint8_t  uarch_latency_table[OP_LAST + 1];
+extern uint8_t  uarch_load_latency;
+extern uint16_t uarch_port_table[OP_LAST + 1];
+
+bool uarch_select(const char* name);
+bool uarch_load_overrides(const char* path);
+const char* uarch_name(void);
+void uarch_print_names(file_t f);
+bool uarch_has_ports(void);
+void uarch_instr_uops(instr_t* instr, std::vector<uint16_t>& uops);
+bool uarch_macro_fuses(instr_t* first, instr_t* second);
+bool uarch_micro_fuses(instr_t* instr);
+int32_t uarch_port_bound(const port_pressure& pressure);
+
+inline int
+instr_latency(instr_t* instr)
+{
+    int lat = uarch_latency_table[instr_get_opcode(instr)];
+    if (instr_reads_memory(instr))
+        lat += uarch_load_latency;
+    return lat;
+}
+
+#endif /* ILP_UARCH_H */